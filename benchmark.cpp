@@ -0,0 +1,1407 @@
+/*
+ * Microbenchmarks for the raycasting core of Candle.
+ *
+ * Everything here runs on the CPU only: no window nor graphics context is
+ * created, so it can run on CI machines. Run with --help to see the options.
+ */
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Candle/geometry/Line.hpp"
+#include "Candle/geometry/Polygon.hpp"
+#include "Candle/geometry/Vector2.hpp"
+
+#include "Candle/LightSource.hpp"
+#include "Candle/RadialLight.hpp"
+#include "Candle/DirectedLight.hpp"
+#include "Candle/CompactEdgeVector.hpp"
+#include "Candle/EdgeGrid.hpp"
+#include "Candle/Trace.hpp"
+
+/*
+ * ALLOCATION COUNTING
+ */
+static std::atomic<unsigned long long> g_allocations(0);
+static std::atomic<unsigned long long> g_allocatedBytes(0);
+
+// Every replaced new and delete goes through this pair. Aligned blocks need
+// their own free on Windows.
+void* countedMalloc(std::size_t n, std::size_t align){
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_allocatedBytes.fetch_add(n, std::memory_order_relaxed);
+    n = n ? n : 1;
+    if(align <= alignof(std::max_align_t)){
+        return std::malloc(n);
+    }
+    n = (n + align - 1) / align * align;
+#ifdef _WIN32
+    return _aligned_malloc(n, align);
+#else
+    return std::aligned_alloc(align, n);
+#endif
+}
+void countedFree(void* p, std::size_t align){
+#ifdef _WIN32
+    if(align > alignof(std::max_align_t)){
+        _aligned_free(p);
+        return;
+    }
+#else
+    (void)align;
+#endif
+    std::free(p);
+}
+void* countedNew(std::size_t n, std::size_t align){
+    if(void* p = countedMalloc(n, align)){
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+const std::size_t DEFAULT_ALIGN = alignof(std::max_align_t);
+void* operator new(std::size_t n){ return countedNew(n, DEFAULT_ALIGN); }
+void* operator new[](std::size_t n){ return countedNew(n, DEFAULT_ALIGN); }
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept{ return countedMalloc(n, DEFAULT_ALIGN); }
+void* operator new[](std::size_t n, const std::nothrow_t&) noexcept{ return countedMalloc(n, DEFAULT_ALIGN); }
+void* operator new(std::size_t n, std::align_val_t a){ return countedNew(n, (std::size_t)a); }
+void* operator new[](std::size_t n, std::align_val_t a){ return countedNew(n, (std::size_t)a); }
+void* operator new(std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept{ return countedMalloc(n, (std::size_t)a); }
+void* operator new[](std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept{ return countedMalloc(n, (std::size_t)a); }
+void operator delete(void* p) noexcept{ countedFree(p, DEFAULT_ALIGN); }
+void operator delete[](void* p) noexcept{ countedFree(p, DEFAULT_ALIGN); }
+void operator delete(void* p, std::size_t) noexcept{ countedFree(p, DEFAULT_ALIGN); }
+void operator delete[](void* p, std::size_t) noexcept{ countedFree(p, DEFAULT_ALIGN); }
+void operator delete(void* p, const std::nothrow_t&) noexcept{ countedFree(p, DEFAULT_ALIGN); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept{ countedFree(p, DEFAULT_ALIGN); }
+void operator delete(void* p, std::align_val_t a) noexcept{ countedFree(p, (std::size_t)a); }
+void operator delete[](void* p, std::align_val_t a) noexcept{ countedFree(p, (std::size_t)a); }
+void operator delete(void* p, std::size_t, std::align_val_t a) noexcept{ countedFree(p, (std::size_t)a); }
+void operator delete[](void* p, std::size_t, std::align_val_t a) noexcept{ countedFree(p, (std::size_t)a); }
+void operator delete(void* p, std::align_val_t a, const std::nothrow_t&) noexcept{ countedFree(p, (std::size_t)a); }
+void operator delete[](void* p, std::align_val_t a, const std::nothrow_t&) noexcept{ countedFree(p, (std::size_t)a); }
+
+/*
+ * AUXILIAR
+ */
+typedef std::chrono::steady_clock Clock;
+
+double secondsSince(const Clock::time_point& t0){
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+// Lights that let us see the polygon of their last cast
+struct ProbeRadialLight: candle::RadialLight{
+    size_t vertexCount() const { return m_polygon.getVertexCount(); }
+    std::vector<sf::Vector2f> worldPolygon() const {
+        // the polygon is in the space of the light texture, whose radius is
+        // the origin of the light
+        sf::Transform trm = getTransform();
+        float scale = getRange() / getOrigin().x;
+        trm.scale({scale, scale}, getOrigin());
+        std::vector<sf::Vector2f> ret;
+        for(size_t i = 0; i < m_polygon.getVertexCount(); i++){
+            ret.push_back(trm.transformPoint(m_polygon[i].position));
+        }
+        return ret;
+    }
+};
+struct BeamRay;
+struct ProbeDirectedLight: candle::DirectedLight{
+    size_t vertexCount() const { return m_polygon.getVertexCount(); }
+    std::vector<BeamRay> beamRays() const;
+};
+
+/*
+ * SCENES
+ */
+struct Scene{
+    std::string name;
+    float size; // side of the square world
+    candle::EdgeVector edges;
+};
+
+// Edge density is kept constant, so a light of fixed range sees roughly the
+// same number of edges whatever the size of the scene.
+const float EDGES_PER_AREA = 1.f / 400.f;
+
+float worldSize(size_t edges){
+    return std::sqrt(edges / EDGES_PER_AREA);
+}
+
+Scene randomScene(size_t n, std::mt19937& rng){
+    Scene scene{"random", worldSize(n), {}};
+    std::uniform_real_distribution<float> pos(0.f, scene.size);
+    std::uniform_real_distribution<float> ang(0.f, 360.f);
+    std::uniform_real_distribution<float> len(5.f, 30.f);
+    scene.edges.reserve(n);
+    for(size_t i = 0; i < n; i++){
+        sfu::Line dir({0.f, 0.f}, ang(rng));
+        sf::Vector2f o(pos(rng), pos(rng));
+        scene.edges.emplace_back(o, o + dir.m_direction * len(rng));
+    }
+    return scene;
+}
+
+// Square blocks laid out in a grid, as in the demo
+Scene gridScene(size_t n, std::mt19937& rng){
+    Scene scene{"grid", worldSize(n), {}};
+    size_t blocks = std::max<size_t>(1, n / 4);
+    size_t cols = std::ceil(std::sqrt((float)blocks));
+    float cell = scene.size / cols;
+    float block = cell / 2.f;
+    std::uniform_real_distribution<float> jitter(-block / 4.f, block / 4.f);
+    scene.edges.reserve(blocks * 4);
+    for(size_t i = 0; i < blocks; i++){
+        sf::Vector2f c(
+            cell * (0.5f + i % cols) + jitter(rng),
+            cell * (0.5f + i / cols) + jitter(rng));
+        const sf::Vector2f points[] = {
+            c + sf::Vector2f(-block/2, -block/2),
+            c + sf::Vector2f( block/2, -block/2),
+            c + sf::Vector2f( block/2,  block/2),
+            c + sf::Vector2f(-block/2,  block/2),
+        };
+        sfu::Polygon p(points, 4);
+        scene.edges.insert(scene.edges.end(), p.lines.begin(), p.lines.end());
+    }
+    return scene;
+}
+
+// Cellular automaton caves, with an edge on each wall/floor boundary
+Scene caveScene(size_t n, std::mt19937& rng){
+    Scene scene{"cave", worldSize(n), {}};
+    // on average, a smoothed cave has about 0.25 boundary edges per cell
+    int dim = std::max(8, (int)std::sqrt(n / 0.25f));
+    float cell = scene.size / dim;
+    std::bernoulli_distribution wall(0.45);
+    std::vector<char> map(dim * dim), next(dim * dim);
+    auto at = [&](int x, int y) -> char {
+        if(x < 0 || y < 0 || x >= dim || y >= dim) return 1;
+        return map[y * dim + x];
+    };
+    for(auto& c: map) c = wall(rng);
+    for(int step = 0; step < 4; step++){
+        for(int y = 0; y < dim; y++){
+            for(int x = 0; x < dim; x++){
+                int walls = 0;
+                for(int dy = -1; dy <= 1; dy++){
+                    for(int dx = -1; dx <= 1; dx++){
+                        walls += at(x + dx, y + dy);
+                    }
+                }
+                next[y * dim + x] = walls >= 5;
+            }
+        }
+        map.swap(next);
+    }
+    for(int y = 0; y < dim; y++){
+        for(int x = 0; x < dim; x++){
+            if(!at(x, y)) continue;
+            sf::Vector2f p(x * cell, y * cell);
+            if(!at(x, y - 1)) scene.edges.emplace_back(p, p + sf::Vector2f(cell, 0));
+            if(!at(x, y + 1)) scene.edges.emplace_back(p + sf::Vector2f(0, cell), p + sf::Vector2f(cell, cell));
+            if(!at(x - 1, y)) scene.edges.emplace_back(p, p + sf::Vector2f(0, cell));
+            if(!at(x + 1, y)) scene.edges.emplace_back(p + sf::Vector2f(cell, 0), p + sf::Vector2f(cell, cell));
+        }
+    }
+    return scene;
+}
+
+// A random scene too big for any cache: 64 MB of sfu::Line, 32 MB quantized.
+// Lights see as many edges as in the other scenes, so it shows what it costs
+// to read the whole pool on every cast.
+const size_t SPRAWL_EDGES = 1 << 22;
+
+Scene sprawlScene(size_t n, std::mt19937& rng){
+    Scene scene = randomScene(std::max(n, SPRAWL_EDGES), rng);
+    scene.name = "sprawl";
+    return scene;
+}
+
+Scene makeScene(const std::string& name, size_t n, unsigned seed){
+    std::mt19937 rng(seed);
+    if(name == "grid") return gridScene(n, rng);
+    if(name == "cave") return caveScene(n, rng);
+    if(name == "sprawl") return sprawlScene(n, rng);
+    return randomScene(n, rng);
+}
+
+/*
+ * RESULTS
+ */
+struct Result{
+    std::string benchmark;
+    std::string scene;
+    size_t edges;
+    int lights;
+    float beamAngle;
+    unsigned long long iterations;
+    unsigned long long rays;
+    double seconds;
+    unsigned long long allocations;
+    unsigned long long allocatedBytes;
+    bool skipped;
+
+    double nsPerRay() const { return rays ? seconds * 1e9 / rays : 0.0; }
+    double raysPerSecond() const { return seconds > 0 ? rays / seconds : 0.0; }
+    double allocationsPerIteration() const { return iterations ? (double)allocations / iterations : 0.0; }
+    double bytesPerIteration() const { return iterations ? (double)allocatedBytes / iterations : 0.0; }
+};
+
+struct Options{
+    std::vector<size_t> edgeCounts = {100, 1000, 10000, 100000, 1000000};
+    std::vector<std::string> scenes = {"random", "grid", "cave", "sprawl"};
+    std::vector<int> lightCounts = {1, 16};
+    std::vector<float> beamAngles = {360.f, 90.f, 30.f};
+    double minTime = 0.25;   // seconds per case
+    double maxWork = 2e9;    // estimated ray/edge tests per iteration
+    unsigned seed = 1;
+    std::string json;
+    std::string trace;
+    bool verify = false;
+    double tolerance = 0.5;
+    unsigned threads = 1;    // per radial light
+};
+
+/*
+ * Run the body until minTime has passed (at least once). The body returns the
+ * number of rays it has cast.
+ */
+template <typename F>
+void measure(Result& res, const Options& opt, F body){
+    unsigned long long a0 = g_allocations.load();
+    unsigned long long b0 = g_allocatedBytes.load();
+    auto t0 = Clock::now();
+    do{
+        res.rays += body();
+        res.iterations++;
+    }while(secondsSince(t0) < opt.minTime);
+    res.seconds = secondsSince(t0);
+    res.allocations = g_allocations.load() - a0;
+    res.allocatedBytes = g_allocatedBytes.load() - b0;
+}
+
+Result makeResult(const std::string& bench, const Scene& scene, int lights, float beam){
+    return Result{bench, scene.name, scene.edges.size(), lights, beam, 0, 0, 0.0, 0, 0, false};
+}
+
+// The range of the lights is fixed, so they see a fixed amount of edges
+const float LIGHT_RANGE = 150.f;
+
+size_t edgesInRange(const Scene& scene){
+    float area = 4.f * LIGHT_RANGE * LIGHT_RANGE;
+    return std::min(scene.edges.size(), (size_t)(area * EDGES_PER_AREA) + 1);
+}
+
+void benchIntersection(const Scene& scene, const Options& opt, std::vector<Result>& out){
+    Result res = makeResult("Line::intersection", scene, 0, 0.f);
+    std::mt19937 rng(opt.seed);
+    std::uniform_real_distribution<float> pos(0.f, scene.size);
+    std::vector<sfu::Line> rays;
+    for(int i = 0; i < 64; i++){
+        rays.emplace_back(sf::Vector2f(pos(rng), pos(rng)), pos(rng));
+    }
+    size_t n = std::min<size_t>(scene.edges.size(), 4096);
+    volatile int hits = 0;
+    measure(res, opt, [&]() -> unsigned long long {
+        for(auto& r: rays){
+            for(size_t i = 0; i < n; i++){
+                float t1, t2;
+                hits += scene.edges[i].intersection(r, t1, t2);
+            }
+        }
+        return rays.size() * n;
+    });
+    out.push_back(res);
+}
+
+void benchCastRay(const Scene& scene, const Options& opt, std::vector<Result>& out){
+    Result res = makeResult("castRay", scene, 0, 0.f);
+    std::mt19937 rng(opt.seed);
+    std::uniform_real_distribution<float> pos(0.f, scene.size);
+    std::uniform_real_distribution<float> ang(0.f, 360.f);
+    size_t n = std::max<size_t>(1, std::min<size_t>(256, opt.maxWork / 16 / scene.edges.size()));
+    std::vector<sfu::Line> rays;
+    for(size_t i = 0; i < n; i++){
+        rays.emplace_back(sf::Vector2f(pos(rng), pos(rng)), ang(rng));
+    }
+    float x = 0.f;
+    measure(res, opt, [&]() -> unsigned long long {
+        for(auto& r: rays){
+            x += sfu::castRay(scene.edges.cbegin(), scene.edges.cend(), r, LIGHT_RANGE).x;
+        }
+        return rays.size();
+    });
+    volatile float sink = x;
+    (void)sink;
+    out.push_back(res);
+}
+
+// Same rays as benchCastRay, decoding the quantized edges on the fly
+void benchCastRayCompact(const Scene& scene, const candle::CompactEdgeVector& compact,
+                         const Options& opt, std::vector<Result>& out){
+    Result res = makeResult("castRay (compact)", scene, 0, 0.f);
+    std::mt19937 rng(opt.seed);
+    std::uniform_real_distribution<float> pos(0.f, scene.size);
+    std::uniform_real_distribution<float> ang(0.f, 360.f);
+    size_t n = std::max<size_t>(1, std::min<size_t>(256, opt.maxWork / 16 / scene.edges.size()));
+    std::vector<sfu::Line> rays;
+    for(size_t i = 0; i < n; i++){
+        rays.emplace_back(sf::Vector2f(pos(rng), pos(rng)), ang(rng));
+    }
+    float x = 0.f;
+    measure(res, opt, [&]() -> unsigned long long {
+        for(auto& r: rays){
+            x += sfu::castRay(compact.begin(), compact.end(), r, LIGHT_RANGE).x;
+        }
+        return rays.size();
+    });
+    volatile float sink = x;
+    (void)sink;
+    out.push_back(res);
+}
+
+// With a CompactEdgeVector, the lights only read the chunks in their bounds
+void benchRadial(Scene& scene, const candle::CompactEdgeVector* compact,
+                 const Options& opt, int nLights, float beam, std::vector<Result>& out){
+    Result res = makeResult(compact ? "RadialLight (compact)" : "RadialLight::castLight", scene, nLights, beam);
+    // every edge is culled, then ~6 rays per edge in range are tested
+    // against the edges in range
+    double work = (scene.edges.size() + 6.0 * edgesInRange(scene) * edgesInRange(scene)) * nLights;
+    if(work > opt.maxWork){
+        res.skipped = true;
+        out.push_back(res);
+        return;
+    }
+    std::mt19937 rng(opt.seed);
+    std::uniform_real_distribution<float> pos(0.f, scene.size);
+    std::uniform_real_distribution<float> ang(0.f, 360.f);
+    std::vector<ProbeRadialLight> lights(nLights);
+    for(auto& l: lights){
+        l.setRange(LIGHT_RANGE);
+        l.setBeamAngle(beam);
+        l.setThreadCount(opt.threads);
+        l.setPosition({pos(rng), pos(rng)});
+        l.setRotation(sf::degrees(ang(rng)));
+    }
+    measure(res, opt, [&]() -> unsigned long long {
+        unsigned long long rays = 0;
+        for(auto& l: lights){
+            if(compact){
+                l.castLight(*compact);
+            }else{
+                l.castLight(scene.edges.begin(), scene.edges.end());
+            }
+            rays += l.vertexCount() - 1;
+        }
+        return rays;
+    });
+    out.push_back(res);
+}
+
+void benchDirected(Scene& scene, const candle::CompactEdgeVector* compact,
+                   const Options& opt, int nLights, std::vector<Result>& out){
+    Result res = makeResult(compact ? "DirectedLight (compact)" : "DirectedLight::castLight", scene, nLights, 0.f);
+    double work = 6.0 * edgesInRange(scene) * scene.edges.size() * nLights;
+    if(work > opt.maxWork){
+        res.skipped = true;
+        out.push_back(res);
+        return;
+    }
+    std::mt19937 rng(opt.seed);
+    std::uniform_real_distribution<float> pos(0.f, scene.size);
+    std::uniform_real_distribution<float> ang(0.f, 360.f);
+    std::vector<ProbeDirectedLight> lights(nLights);
+    for(auto& l: lights){
+        l.setRange(LIGHT_RANGE * 2);
+        l.setBeamWidth(LIGHT_RANGE * 2);
+        l.setPosition({pos(rng), pos(rng)});
+        l.setRotation(sf::degrees(ang(rng)));
+    }
+    measure(res, opt, [&]() -> unsigned long long {
+        unsigned long long rays = 0;
+        for(auto& l: lights){
+            if(compact){
+                l.castLight(*compact);
+            }else{
+                l.castLight(scene.edges.begin(), scene.edges.end());
+            }
+            rays += l.vertexCount() / 2;
+        }
+        return rays;
+    });
+    out.push_back(res);
+}
+
+/*
+ * OUTPUT
+ */
+void printResult(const Result& r){
+    std::cout << std::left << std::setw(26) << r.benchmark
+              << std::setw(8) << r.scene
+              << std::right << std::setw(9) << r.edges
+              << std::setw(5) << r.lights
+              << std::fixed << std::setprecision(0)
+              << std::setw(6) << r.beamAngle;
+    if(r.skipped){
+        std::cout << "   skipped (too much work)" << std::endl;
+        return;
+    }
+    std::cout << std::setprecision(1)
+              << std::setw(14) << r.nsPerRay()
+              << std::setw(16) << std::setprecision(0) << r.raysPerSecond()
+              << std::setw(12) << std::setprecision(1) << r.allocationsPerIteration()
+              << std::endl;
+}
+
+std::string jsonEscape(const std::string& s){
+    std::string ret;
+    for(char c: s){
+        if(c == '"' || c == '\\') ret += '\\';
+        ret += c;
+    }
+    return ret;
+}
+
+bool writeJson(const std::string& path, const Options& opt, const std::vector<Result>& results){
+    std::ofstream f(path);
+    if(!f){
+        return false;
+    }
+    f << "{\n"
+      << "  \"timestamp\": " << std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count() << ",\n"
+      << "  \"seed\": " << opt.seed << ",\n"
+      << "  \"min_time\": " << opt.minTime << ",\n"
+      << "  \"results\": [";
+    for(size_t i = 0; i < results.size(); i++){
+        const Result& r = results[i];
+        f << (i ? "," : "") << "\n    {"
+          << "\"benchmark\": \"" << jsonEscape(r.benchmark) << "\", "
+          << "\"scene\": \"" << jsonEscape(r.scene) << "\", "
+          << "\"edges\": " << r.edges << ", "
+          << "\"lights\": " << r.lights << ", "
+          << "\"beam_angle\": " << r.beamAngle << ", "
+          << "\"skipped\": " << (r.skipped ? "true" : "false") << ", "
+          << "\"iterations\": " << r.iterations << ", "
+          << "\"rays\": " << r.rays << ", "
+          << "\"seconds\": " << r.seconds << ", "
+          << "\"ns_per_ray\": " << r.nsPerRay() << ", "
+          << "\"rays_per_second\": " << r.raysPerSecond() << ", "
+          << "\"allocations_per_iteration\": " << r.allocationsPerIteration() << ", "
+          << "\"bytes_per_iteration\": " << r.bytesPerIteration()
+          << "}";
+    }
+    f << "\n  ]\n}\n";
+    return (bool)f;
+}
+
+/*
+ * VERIFICATION
+ *
+ * Every cast path of the library is compared against a reference: a brute
+ * force implementation of the raycasting, in double precision and with its
+ * own intersection code, so it doesn't share bugs with the library. The
+ * polygons are compared as functions of the angle (radial lights) or of the
+ * position across the beam (directed lights), clipped to the range of the
+ * light, so paths may produce different vertices and still agree. Samples
+ * too close to the rays of either polygon are skipped, because the rays
+ * casted at both sides of an endpoint leave a sliver that is ambiguous by
+ * design.
+ *
+ * The line of sight checks of EdgeGrid are compared against the same test
+ * over every edge, so any difference comes from the cells it walks.
+ */
+const double NO_HIT = std::numeric_limits<double>::infinity();
+const double REF_PI = 3.14159265358979323846;
+
+struct RadialCase{
+    sf::Vector2f position;
+    float rotation;
+    float beamAngle;
+    float range;
+};
+
+struct DirectedCase{
+    sf::Vector2f position;
+    float rotation;
+    float beamWidth;
+    float range;
+};
+
+struct VerifyScene{
+    std::string name;
+    candle::EdgeVector edges;
+    std::vector<RadialCase> radial;
+    std::vector<DirectedCase> directed;
+    candle::CircleVector circles; // only seen by the radial lights
+};
+
+// A ray as seen by a directed light: parameter across the beam and length
+struct BeamRay{
+    double param;
+    double length;
+};
+
+// The polygon is made of quads between consecutive rays, in the space of the
+// light: the rays go along the X axis and the beam spans the Y axis.
+std::vector<BeamRay> ProbeDirectedLight::beamRays() const {
+    std::vector<BeamRay> ret;
+    float w = getBeamWidth();
+    for(size_t i = 0; i + 3 < m_polygon.getVertexCount(); i += 4){
+        for(size_t j = (i == 0 ? 0 : 2); j <= 2; j += 2){
+            const sf::Vector2f& o = m_polygon[i + j].position;
+            const sf::Vector2f& h = m_polygon[i + j + 1].position;
+            ret.push_back({(o.y + w / 2) / w, h.x - o.x});
+        }
+    }
+    std::sort(ret.begin(), ret.end(), [](const BeamRay& a, const BeamRay& b){
+        return a.param < b.param;
+    });
+    return ret;
+}
+
+double angleOf(double x, double y){
+    double a = std::atan2(y, x) * 180.0 / REF_PI;
+    return a < 0 ? a + 360.0 : a;
+}
+
+double mod360(double a){
+    a = std::fmod(a, 360.0);
+    return a < 0 ? a + 360.0 : a;
+}
+
+// Distance from (px,py) along (dx,dy), normalized, to the closest edge
+double nearestHit(const candle::EdgeVector& edges, double px, double py, double dx, double dy){
+    double best = NO_HIT;
+    for(auto& e: edges){
+        double ax = e.m_origin.x, ay = e.m_origin.y;
+        double ex = e.m_direction.x, ey = e.m_direction.y;
+        double den = dx * ey - dy * ex;
+        if(std::abs(den) < 1e-12){
+            continue; // parallel
+        }
+        double wx = ax - px, wy = ay - py;
+        double t = (wx * ey - wy * ex) / den;
+        double u = (wx * dy - wy * dx) / den;
+        if(t > 1e-9 && u >= 0.0 && u <= 1.0 && t < best){
+            best = t;
+        }
+    }
+    return best;
+}
+
+// Distance from (px,py) along (dx,dy), normalized, to the closest circle.
+// Rays along a tangent touch the circle.
+double nearestCircleHit(const candle::CircleVector& circles, double px, double py, double dx, double dy){
+    double best = NO_HIT;
+    for(auto& k: circles){
+        double ox = px - k.m_center.x, oy = py - k.m_center.y, r = k.m_radius;
+        double b = ox * dx + oy * dy;
+        double disc = b * b - (ox * ox + oy * oy - r * r);
+        if(disc < -1e-6 * r * r){
+            continue;
+        }
+        double root = std::sqrt(std::max(disc, 0.0));
+        double t = -b - root >= 0.0 ? -b - root : -b + root;
+        if(t >= 0.0 && t < best){
+            best = t;
+        }
+    }
+    return best;
+}
+
+// Reference radial polygon, in world coordinates, with the center first.
+// Circles cast a ray to each tangent point and one just past each of them,
+// and the front of a circle is the chord between its tangent points.
+std::vector<sf::Vector2f> radialReference(const candle::EdgeVector& edges, const candle::CircleVector& circles,
+                                          const RadialCase& c){
+    const double off = 0.001;
+    double bl1 = mod360(c.rotation - c.beamAngle / 2.0);
+    bool full = mod360(c.beamAngle) < 0.1;
+    double beam = full ? 360.0 : mod360(c.beamAngle);
+    auto inBeam = [&](double a){
+        double rel = mod360(a - bl1);
+        return full || (rel > 0.0 && rel < beam);
+    };
+    // rays along the arc, as in the library
+    std::vector<double> angles;
+    if(full){
+        for(double a = 45.0; a < 360.0; a += 90.0){
+            angles.push_back(a);
+        }
+    }else{
+        int arcRays = beam / 90.0;
+        for(int i = 1; i <= arcRays; i++){
+            angles.push_back(bl1 + beam * i / (arcRays + 1));
+        }
+    }
+    double px = c.position.x, py = c.position.y, r = c.range;
+    // edges out of the range are ignored, as in the library: they would
+    // only add vertices on the arcs of the circles, and hits past the range
+    // that move the fan between two rays
+    candle::EdgeVector seenEdges;
+    for(auto& e: edges){
+        sf::Vector2f p1 = e.m_origin, p2 = e.point(1.f);
+        double ex = e.m_direction.x, ey = e.m_direction.y, len2 = ex * ex + ey * ey;
+        double u = len2 > 0.0 ? ((px - p1.x) * ex + (py - p1.y) * ey) / len2 : 0.0;
+        u = std::max(0.0, std::min(1.0, u));
+        double qx = p1.x + u * ex - px, qy = p1.y + u * ey - py;
+        if(qx * qx + qy * qy > r * r){
+            continue;
+        }
+        seenEdges.push_back(e);
+        for(sf::Vector2f p: {p1, p2}){
+            double a = angleOf(p.x - px, p.y - py);
+            for(double b: {a, a - off, a + off}){
+                if(inBeam(b)) angles.push_back(b);
+            }
+        }
+    }
+    // circles that contain the light or are out of its range are ignored
+    candle::CircleVector seen;
+    for(auto& k: circles){
+        double cx = k.m_center.x - px, cy = k.m_center.y - py;
+        double d = std::sqrt(cx * cx + cy * cy);
+        if(d <= k.m_radius || d > r + k.m_radius){
+            continue;
+        }
+        seen.push_back(k);
+        double a = angleOf(cx, cy);
+        double half = std::asin(k.m_radius / d) * 180.0 / REF_PI;
+        for(double b: {a - half, a + half, a - half - off, a + half + off}){
+            if(inBeam(b)) angles.push_back(b);
+        }
+    }
+    // sorted from the start of the beam
+    std::sort(angles.begin(), angles.end(), [&](double a1, double a2){
+        return mod360(a1 - bl1 + 0.1) < mod360(a2 - bl1 + 0.1);
+    });
+    if(!full){
+        angles.insert(angles.begin(), bl1);
+        angles.push_back(bl1 + beam);
+    }
+    std::vector<sf::Vector2f> fan(1, c.position);
+    for(double a: angles){
+        double dx = std::cos(a * REF_PI / 180.0), dy = std::sin(a * REF_PI / 180.0);
+        double t = std::min({nearestHit(seenEdges, px, py, dx, dy),
+                             nearestCircleHit(seen, px, py, dx, dy), r * r});
+        fan.emplace_back(px + dx * t, py + dy * t);
+    }
+    if(full){
+        fan.push_back(fan[1]);
+    }
+    return fan;
+}
+
+// Reference directed rays, sorted across the beam
+std::vector<BeamRay> directedReference(const candle::EdgeVector& edges, const DirectedCase& c){
+    double rot = c.rotation * REF_PI / 180.0;
+    double dx = std::cos(rot), dy = std::sin(rot); // direction of the light
+    double nx = -dy, ny = dx;                      // across the beam
+    double half = c.beamWidth / 2.0;
+    double ox = c.position.x - nx * half, oy = c.position.y - ny * half; // param 0
+    double off = 0.01 / c.beamWidth;
+    std::vector<double> params = {0.0, 1.0};
+    auto local = [&](sf::Vector2f p, double& along, double& across){
+        double wx = p.x - ox, wy = p.y - oy;
+        along = wx * dx + wy * dy;
+        across = (wx * nx + wy * ny) / c.beamWidth;
+    };
+    for(auto& e: edges){
+        double a1, s1, a2, s2;
+        local(e.m_origin, a1, s1);
+        local(e.point(1.f), a2, s2);
+        // crossing of the far end of the beam
+        if((a1 - c.range) * (a2 - c.range) < 0.0){
+            double s = s1 + (s2 - s1) * (c.range - a1) / (a2 - a1);
+            if(s >= 0.0 && s <= 1.0){
+                params.push_back(s);
+            }
+        }
+        for(int i = 0; i < 2; i++){
+            double a = i ? a2 : a1, s = i ? s2 : s1;
+            if(a >= 0.0 && a < c.range && s >= 0.0 && s < 1.0){
+                params.push_back(s - off);
+                params.push_back(s);
+                params.push_back(s + off);
+            }
+        }
+    }
+    std::sort(params.begin(), params.end());
+    std::vector<BeamRay> rays;
+    for(double s: params){
+        double px = ox + nx * s * c.beamWidth, py = oy + ny * s * c.beamWidth;
+        rays.push_back({s, std::min(nearestHit(edges, px, py, dx, dy), (double)c.range)});
+    }
+    return rays;
+}
+
+// Distance lit by a fan in a direction, or 0 if it isn't covered
+double fanDistance(const std::vector<sf::Vector2f>& fan, double ux, double uy){
+    double best = 0.0;
+    double cx = fan[0].x, cy = fan[0].y;
+    for(size_t i = 1; i + 1 < fan.size(); i++){
+        double ax = fan[i].x - cx, ay = fan[i].y - cy;
+        double bx = fan[i+1].x - cx, by = fan[i+1].y - cy;
+        if(ax * by - ay * bx <= 0.0) continue; // degenerate or reflex
+        if(ax * uy - ay * ux < 0.0 || ux * by - uy * bx < 0.0) continue;
+        double ex = bx - ax, ey = by - ay;
+        double den = ux * ey - uy * ex;
+        if(std::abs(den) < 1e-12) continue;
+        best = std::max(best, (ax * ey - ay * ex) / den);
+    }
+    return best;
+}
+
+// Length lit by a directed light at a parameter across the beam
+double beamDistance(const std::vector<BeamRay>& rays, double s){
+    for(size_t i = 0; i + 1 < rays.size(); i++){
+        const BeamRay& r1 = rays[i];
+        const BeamRay& r2 = rays[i+1];
+        if(r1.param <= s && s <= r2.param && r2.param > r1.param){
+            return r1.length + (r2.length - r1.length) * (s - r1.param) / (r2.param - r1.param);
+        }
+    }
+    return 0.0;
+}
+
+// True if x is closer than eps to some value of the sorted vector
+bool nearAny(const std::vector<double>& sorted, double x, double eps){
+    auto it = std::lower_bound(sorted.begin(), sorted.end(), x - eps);
+    return it != sorted.end() && *it <= x + eps;
+}
+
+struct Divergence{
+    double maxError = 0.0;
+    double at = 0.0;
+    int samples = 0;
+};
+
+Divergence compareRadial(const std::vector<sf::Vector2f>& ref,
+                         const std::vector<sf::Vector2f>& got,
+                         const RadialCase& c){
+    const int SAMPLES = 1440;
+    const double WINDOW = 0.01; // degrees
+    std::vector<double> rayAngles;
+    for(auto* fan: {&ref, &got}){
+        for(size_t i = 1; i < fan->size(); i++){
+            sf::Vector2f d = (*fan)[i] - (*fan)[0];
+            double a = angleOf(d.x, d.y);
+            rayAngles.push_back(a);
+            rayAngles.push_back(a + 360.0);
+            rayAngles.push_back(a - 360.0);
+        }
+    }
+    std::sort(rayAngles.begin(), rayAngles.end());
+    bool full = mod360(c.beamAngle) < 0.1;
+    double beam = full ? 360.0 : mod360(c.beamAngle);
+    double start = c.rotation - beam / 2.0;
+    // stay away from the limits of the beam, which are blurred by the library
+    double margin = full ? 0.0 : 0.2;
+    Divergence d;
+    for(int i = 0; i < SAMPLES; i++){
+        double a = start + margin + (beam - 2 * margin) * (i + 0.5) / SAMPLES;
+        if(nearAny(rayAngles, mod360(a), WINDOW)){
+            continue;
+        }
+        double ux = std::cos(a * REF_PI / 180.0), uy = std::sin(a * REF_PI / 180.0);
+        double e = std::abs(std::min(fanDistance(ref, ux, uy), (double)c.range)
+                          - std::min(fanDistance(got, ux, uy), (double)c.range));
+        d.samples++;
+        if(e > d.maxError){
+            d.maxError = e;
+            d.at = mod360(a);
+        }
+    }
+    return d;
+}
+
+Divergence compareDirected(const std::vector<BeamRay>& ref,
+                           const std::vector<BeamRay>& got,
+                           const DirectedCase& c){
+    const int SAMPLES = 1000;
+    double window = 0.02 / c.beamWidth;
+    std::vector<double> params;
+    for(auto* rays: {&ref, &got}){
+        for(auto& r: *rays) params.push_back(r.param);
+    }
+    std::sort(params.begin(), params.end());
+    Divergence d;
+    for(int i = 0; i < SAMPLES; i++){
+        double s = (i + 0.5) / SAMPLES;
+        if(nearAny(params, s, window)){
+            continue;
+        }
+        double e = std::abs(beamDistance(ref, s) - beamDistance(got, s));
+        d.samples++;
+        if(e > d.maxError){
+            d.maxError = e;
+            d.at = s;
+        }
+    }
+    return d;
+}
+
+/*
+ * Cast paths of the library under verification. Each one casts a light as
+ * described by the case and returns its polygon in the format of the
+ * reference.
+ */
+typedef std::function<std::vector<sf::Vector2f>(candle::EdgeVector&, const candle::CircleVector&,
+                                                const RadialCase&)> RadialPath;
+typedef std::function<std::vector<BeamRay>(candle::EdgeVector&, const DirectedCase&)> DirectedPath;
+
+// Quantized paths are compared with the reference of the decoded edges, as
+// quantization may change the topology of degenerate scenes (e.g. a light
+// exactly on an edge)
+template <typename F>
+struct CastPath{
+    std::string name;
+    F cast;
+    bool quantized;
+};
+
+std::vector<sf::Vector2f> castRadial(ProbeRadialLight& light, candle::EdgeVector& edges,
+                                     const candle::CircleVector& circles, const RadialCase& c,
+                                     bool compact = false){
+    light.setPosition(c.position);
+    light.setRotation(sf::degrees(c.rotation));
+    light.setBeamAngle(c.beamAngle);
+    light.setRange(c.range);
+    if(compact){
+        light.castLight(candle::CompactEdgeVector(edges.begin(), edges.end()));
+    }else if(!circles.empty()){
+        light.castLight(edges.begin(), edges.end(), circles.cbegin(), circles.cend());
+    }else{
+        light.castLight(edges.begin(), edges.end());
+    }
+    return light.worldPolygon();
+}
+
+std::vector<BeamRay> castDirected(ProbeDirectedLight& light, candle::EdgeVector& edges, const DirectedCase& c, bool compact = false){
+    light.setPosition(c.position);
+    light.setRotation(sf::degrees(c.rotation));
+    light.setBeamWidth(c.beamWidth);
+    light.setRange(c.range);
+    if(compact){
+        light.castLight(candle::CompactEdgeVector(edges.begin(), edges.end()));
+    }else{
+        light.castLight(edges.begin(), edges.end());
+    }
+    return light.beamRays();
+}
+
+// The merged path removes vertices up to half the tolerance of the check
+std::vector<CastPath<RadialPath>> radialPaths(double tolerance){
+    return {
+        {"castLight", [](candle::EdgeVector& edges, const candle::CircleVector& circles, const RadialCase& c){
+            ProbeRadialLight light;
+            return castRadial(light, edges, circles, c);
+        }, false},
+        {"castLight (threads)", [](candle::EdgeVector& edges, const candle::CircleVector& circles, const RadialCase& c){
+            ProbeRadialLight light;
+            light.setThreadCount(4);
+            return castRadial(light, edges, circles, c);
+        }, false},
+        {"castLight (merged)", [tolerance](candle::EdgeVector& edges, const candle::CircleVector& circles, const RadialCase& c){
+            ProbeRadialLight light;
+            light.setMergeTolerance(tolerance / 2);
+            return castRadial(light, edges, circles, c);
+        }, false},
+        {"castLight (compact)", [](candle::EdgeVector& edges, const candle::CircleVector& circles, const RadialCase& c){
+            ProbeRadialLight light;
+            return castRadial(light, edges, circles, c, true);
+        }, true},
+    };
+}
+
+std::vector<CastPath<DirectedPath>> directedPaths(){
+    return {
+        {"castLight", [](candle::EdgeVector& edges, const DirectedCase& c){
+            ProbeDirectedLight light;
+            return castDirected(light, edges, c);
+        }, false},
+        {"castLight (compact)", [](candle::EdgeVector& edges, const DirectedCase& c){
+            ProbeDirectedLight light;
+            return castDirected(light, edges, c, true);
+        }, true},
+    };
+}
+
+/*
+ * Verification scenes: seeded random ones and hand made adversarial ones.
+ */
+// The rays are only casted to the endpoints of the edges, so the polygons
+// are only exact if edges don't cross each other.
+candle::EdgeVector removeCrossings(const candle::EdgeVector& edges){
+    candle::EdgeVector ret;
+    auto side = [](sf::Vector2f a, sf::Vector2f b, sf::Vector2f p){
+        double c = (double)(b.x - a.x) * (p.y - a.y) - (double)(b.y - a.y) * (p.x - a.x);
+        return (c > 0) - (c < 0);
+    };
+    for(auto& e: edges){
+        sf::Vector2f a = e.m_origin, b = e.point(1.f);
+        bool crosses = false;
+        for(auto& f: ret){
+            sf::Vector2f c = f.m_origin, d = f.point(1.f);
+            if(side(a, b, c) * side(a, b, d) < 0 && side(c, d, a) * side(c, d, b) < 0){
+                crosses = true;
+                break;
+            }
+        }
+        if(!crosses) ret.push_back(e);
+    }
+    return ret;
+}
+
+void addRandomCases(VerifyScene& scene, float size, unsigned seed){
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> pos(0.f, size);
+    std::uniform_real_distribution<float> ang(0.f, 360.f);
+    const float beams[] = {360.f, 200.f, 90.f, 30.f, 5.f};
+    for(float beam: beams){
+        scene.radial.push_back({{pos(rng), pos(rng)}, ang(rng), beam, LIGHT_RANGE});
+    }
+    // beams that wrap around 0 degrees (bl1 > bl2)
+    scene.radial.push_back({{pos(rng), pos(rng)}, 0.f, 90.f, LIGHT_RANGE});
+    scene.radial.push_back({{pos(rng), pos(rng)}, 350.f, 60.f, LIGHT_RANGE});
+    for(int i = 0; i < 3; i++){
+        scene.directed.push_back({{pos(rng), pos(rng)}, ang(rng), LIGHT_RANGE, LIGHT_RANGE * 2});
+    }
+}
+
+std::vector<VerifyScene> verifyScenes(unsigned seed){
+    std::vector<VerifyScene> scenes;
+    for(std::string name: {"random", "grid", "cave"}){
+        for(size_t n: {100, 2000}){
+            Scene s = makeScene(name, n, seed + n);
+            VerifyScene vs{name + "-" + std::to_string(n), removeCrossings(s.edges), {}, {}, {}};
+            addRandomCases(vs, s.size, seed + n);
+            scenes.push_back(vs);
+        }
+    }
+    const sf::Vector2f O(0.f, 0.f);
+    {
+        // collinear edges: split walls, overlapping segments and edges
+        // pointing to the light
+        VerifyScene s{"collinear", {}, {}, {}, {}};
+        for(int i = -5; i < 5; i++){
+            s.edges.emplace_back(sf::Vector2f(i * 20.f, 50.f), sf::Vector2f(i * 20.f + 20.f, 50.f));
+            s.edges.emplace_back(sf::Vector2f(-60.f, i * 15.f), sf::Vector2f(-60.f, i * 15.f + 15.f));
+        }
+        s.edges.emplace_back(sf::Vector2f(10.f, -40.f), sf::Vector2f(50.f, -40.f));
+        s.edges.emplace_back(sf::Vector2f(30.f, -40.f), sf::Vector2f(70.f, -40.f));
+        s.edges.emplace_back(sf::Vector2f(30.f, 30.f), sf::Vector2f(45.f, 45.f));
+        s.edges.emplace_back(sf::Vector2f(60.f, 0.f), sf::Vector2f(90.f, 0.f));
+        s.radial = {{O, 0.f, 360.f, 100.f}, {O, 90.f, 90.f, 100.f},
+                    {O, 0.f, 90.f, 100.f}, {{5.f, 5.f}, 45.f, 180.f, 120.f}};
+        s.directed = {{{-80.f, 0.f}, 0.f, 150.f, 200.f}, {{0.f, -80.f}, 90.f, 150.f, 200.f}};
+        scenes.push_back(s);
+    }
+    {
+        // endpoints exactly on the corner rays, on the limits of the beam and
+        // several endpoints on the same ray
+        VerifyScene s{"endpoints-on-rays", {}, {}, {}, {}};
+        for(float d: {20.f, 40.f, 60.f}){
+            s.edges.emplace_back(sf::Vector2f(d, d), sf::Vector2f(d + 10.f, d - 10.f));
+            s.edges.emplace_back(sf::Vector2f(-d, d), sf::Vector2f(-d - 10.f, d - 10.f));
+            s.edges.emplace_back(sf::Vector2f(-d, -d), sf::Vector2f(-d + 10.f, -d - 10.f));
+        }
+        s.edges.emplace_back(sf::Vector2f(70.f, 0.f), sf::Vector2f(0.f, 70.f));
+        s.edges.emplace_back(sf::Vector2f(80.f, -20.f), sf::Vector2f(80.f, 20.f));
+        s.radial = {{O, 0.f, 360.f, 100.f}, {O, 90.f, 90.f, 100.f},
+                    {O, 0.f, 90.f, 100.f}, {O, 45.f, 90.f, 100.f}, {O, 315.f, 180.f, 100.f}};
+        s.directed = {{{0.f, 0.f}, 45.f, 100.f, 150.f}};
+        scenes.push_back(s);
+    }
+    {
+        // lights on top of edges and endpoints
+        VerifyScene s{"light-on-edge", {}, {}, {}, {}};
+        s.edges.emplace_back(sf::Vector2f(-50.f, 0.f), sf::Vector2f(50.f, 0.f));
+        s.edges.emplace_back(sf::Vector2f(50.f, 0.f), sf::Vector2f(50.f, 50.f));
+        s.edges.emplace_back(sf::Vector2f(-30.f, 40.f), sf::Vector2f(20.f, 40.f));
+        s.edges.emplace_back(sf::Vector2f(-30.f, -40.f), sf::Vector2f(20.f, -60.f));
+        s.radial = {{O, 0.f, 360.f, 100.f}, {{50.f, 0.f}, 0.f, 360.f, 100.f},
+                    {{50.f, 25.f}, 180.f, 90.f, 100.f}, {{-20.f, 0.f}, 270.f, 120.f, 100.f}};
+        s.directed = {{{-50.f, 0.f}, 90.f, 100.f, 100.f}};
+        scenes.push_back(s);
+    }
+    {
+        // round occluders: overlapping circles, circles in front of and
+        // behind edges and of each other, and lights inside a circle and on
+        // the tangents of others
+        VerifyScene s{"circles", {}, {}, {}, {}};
+        s.circles = {{{40.f, 0.f}, 10.f}, {{55.f, 12.f}, 8.f}, {{-30.f, -30.f}, 15.f},
+                     {{0.f, 60.f}, 5.f}, {{0.f, 75.f}, 12.f}, {{-70.f, 20.f}, 20.f},
+                     {{10.f, -20.f}, 4.f}, {{-20.f, 5.f}, 3.f}};
+        s.edges.emplace_back(sf::Vector2f(-50.f, -45.f), sf::Vector2f(-50.f, 45.f));
+        s.edges.emplace_back(sf::Vector2f(20.f, 40.f), sf::Vector2f(60.f, 40.f));
+        s.edges.emplace_back(sf::Vector2f(70.f, -30.f), sf::Vector2f(70.f, 30.f));
+        s.radial = {{O, 0.f, 360.f, 100.f}, {O, 0.f, 90.f, 100.f}, {O, 350.f, 60.f, 100.f},
+                    {O, 90.f, 10.f, 100.f}, {{40.f, 0.f}, 0.f, 360.f, 100.f},
+                    {{0.f, 12.f}, 180.f, 200.f, 120.f}, {{-45.f, -60.f}, 45.f, 360.f, 150.f}};
+        scenes.push_back(s);
+    }
+    {
+        // circles scattered over a random scene
+        Scene base = makeScene("random", 500, seed + 1);
+        VerifyScene s{"circles-random", removeCrossings(base.edges), {}, {}, {}};
+        std::mt19937 rng(seed + 1);
+        std::uniform_real_distribution<float> pos(0.f, base.size);
+        std::uniform_real_distribution<float> radius(2.f, 20.f);
+        for(int i = 0; i < 60; i++){
+            s.circles.push_back({{pos(rng), pos(rng)}, radius(rng)});
+        }
+        addRandomCases(s, base.size, seed + 1);
+        scenes.push_back(s);
+    }
+    {
+        // beams that wrap around 0 degrees, over a random scene
+        Scene base = makeScene("random", 500, seed);
+        VerifyScene s{"wrap-around", removeCrossings(base.edges), {}, {}, {}};
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> pos(0.f, base.size);
+        const float rotations[] = {0.f, 10.f, 350.f, 359.9f, 0.1f};
+        const float beams[] = {20.f, 90.f, 181.f, 300.f, 359.f};
+        for(float r: rotations){
+            for(float b: beams){
+                s.radial.push_back({{pos(rng), pos(rng)}, r, b, LIGHT_RANGE});
+            }
+        }
+        scenes.push_back(s);
+    }
+    {
+        // edges along the sides and diagonals of the cells of an EdgeGrid,
+        // and from their corners, only for the line of sight checks
+        VerifyScene s{"cell-corners", {}, {}, {}, {}};
+        const float cell = candle::EdgeGrid().getCellSize();
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<int> kind(0, 5);
+        std::uniform_real_distribution<float> inside(0.1f, 0.9f);
+        for(int y = 0; y < 8; y++){
+            for(int x = 0; x < 8; x++){
+                sf::Vector2f c(x * cell, y * cell);
+                switch(kind(rng)){
+                case 0: s.edges.emplace_back(c, c + sf::Vector2f(cell, 0.f)); break;
+                case 1: s.edges.emplace_back(c, c + sf::Vector2f(0.f, cell)); break;
+                case 2: s.edges.emplace_back(c, c + sf::Vector2f(cell, cell)); break;
+                case 3: s.edges.emplace_back(c + sf::Vector2f(cell, 0.f), c + sf::Vector2f(0.f, cell)); break;
+                case 4: s.edges.emplace_back(c, c + cell * sf::Vector2f(inside(rng), inside(rng))); break;
+                default: break;
+                }
+            }
+        }
+        scenes.push_back(s);
+    }
+    return scenes;
+}
+
+// The test of EdgeGrid, over every edge, so only the cells walked by the
+// grid are checked
+bool bruteIntersects(const candle::EdgeVector& edges, const sfu::Line& segment){
+    for(auto& e: edges){
+        float d = segment.m_direction.cross(e.m_direction);
+        if(d == 0.f) continue;
+        sf::Vector2f o = e.m_origin - segment.m_origin;
+        float t = o.cross(e.m_direction) / d;
+        float u = o.cross(segment.m_direction) / d;
+        if(t >= 0.f && t <= 1.f && u >= 0.f && u <= 1.f) return true;
+    }
+    return false;
+}
+
+// Segments inside the grid, starting or ending out of it, crossing it
+// whole, through the corners of the cells and along their sides
+std::vector<sfu::Line> gridSegments(const candle::EdgeGrid& grid, unsigned seed){
+    const candle::EdgeVector& edges = grid.getEdges();
+    sf::Vector2f low = edges[0].m_origin, high = low;
+    for(auto& e: edges){
+        for(sf::Vector2f p: {e.m_origin, e.point(1.f)}){
+            low = {std::min(low.x, p.x), std::min(low.y, p.y)};
+            high = {std::max(high.x, p.x), std::max(high.y, p.y)};
+        }
+    }
+    float cell = grid.getCellSize();
+    sf::Vector2f size = high - low;
+    int cols = std::floor(size.x / cell) + 1, rows = std::floor(size.y / cell) + 1;
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    std::uniform_real_distribution<float> ang(0.f, 2.f * REF_PI);
+    std::uniform_real_distribution<float> around(-0.5f, 1.5f);
+    std::uniform_int_distribution<int> col(0, cols), row(0, rows);
+    auto inGrid = [&]{ return low + sf::Vector2f(unit(rng) * size.x, unit(rng) * size.y); };
+    auto nearGrid = [&]{ return low + sf::Vector2f(around(rng) * size.x, around(rng) * size.y); };
+    auto corner = [&]{ return low + cell * sf::Vector2f(col(rng), row(rng)); };
+    auto polar = [&](float len){ float a = ang(rng); return len * sf::Vector2f(std::cos(a), std::sin(a)); };
+    std::vector<sfu::Line> segments;
+    for(int i = 0; i < 400; i++){
+        sf::Vector2f p = inGrid();
+        segments.emplace_back(p, p + polar(unit(rng) * 4.f * cell));
+    }
+    for(int i = 0; i < 400; i++){
+        // from out of the grid, most of them into it or across it
+        sf::Vector2f p = nearGrid();
+        segments.emplace_back(p, i % 2 ? inGrid() : nearGrid());
+    }
+    for(int i = 0; i < 400; i++){
+        // through a corner, starting or ending on it for some
+        sf::Vector2f c = corner(), d = polar(unit(rng) * 4.f * cell);
+        float before = i % 4 == 0 ? 0.f : i % 4 == 1 ? 1.f : unit(rng);
+        segments.emplace_back(c - before * d, c + (1.f - before) * d);
+    }
+    for(int i = 0; i < 400; i++){
+        // diagonals and sides of the cells, from corner to corner
+        sf::Vector2f c = corner();
+        int n = 1 + i % 4;
+        float sx = i % 8 < 4 ? 1.f : -1.f, sy = i % 16 < 8 ? 1.f : -1.f;
+        switch(i % 3){
+        case 0: segments.emplace_back(c, c + n * cell * sf::Vector2f(sx, sy)); break;
+        case 1: segments.emplace_back(c, c + n * cell * sf::Vector2f(sx, 0.f)); break;
+        default: segments.emplace_back(c, c + n * cell * sf::Vector2f(0.f, sy)); break;
+        }
+    }
+    return segments;
+}
+
+// EdgeGrid::intersects, for single segments and in batches with one and
+// several threads, against the brute force
+void verifyEdgeGrid(const VerifyScene& scene, unsigned seed, int& checks, int& failures){
+    if(scene.edges.empty()) return;
+    candle::EdgeGrid grid(scene.edges.begin(), scene.edges.end());
+    std::vector<sfu::Line> segments = gridSegments(grid, seed);
+    std::vector<char> batched[2];
+    grid.setThreadCount(1);
+    grid.intersects(segments, batched[0]);
+    grid.setThreadCount(4);
+    grid.intersects(segments, batched[1]);
+    for(size_t i = 0; i < segments.size(); i++){
+        bool ref = bruteIntersects(scene.edges, segments[i]);
+        const std::pair<const char*, bool> paths[] = {
+            {"intersects", grid.intersects(segments[i])},
+            {"batched, 1 thread", batched[0][i] != 0},
+            {"batched, 4 threads", batched[1][i] != 0},
+        };
+        checks++;
+        for(auto& path: paths){
+            if(path.second != ref){
+                failures++;
+                const sfu::Line& s = segments[i];
+                std::cout << "FAIL " << scene.name << " segment #" << i << " (" << path.first << "): "
+                          << (ref ? "missed" : "false hit") << " from (" << s.m_origin.x << ", "
+                          << s.m_origin.y << ") to (" << s.point(1.f).x << ", " << s.point(1.f).y
+                          << ")" << std::endl;
+                break;
+            }
+        }
+    }
+}
+
+int verify(unsigned seed, double tolerance){
+    int failures = 0, checks = 0;
+    auto report = [&](const std::string& scene, const std::string& path,
+                      const std::string& light, size_t i, const Divergence& d){
+        checks++;
+        if(d.maxError > tolerance){
+            failures++;
+            std::cout << "FAIL " << scene << " " << light << " #" << i << " (" << path
+                      << "): error " << d.maxError << " at " << d.at
+                      << " over " << d.samples << " samples" << std::endl;
+        }
+    };
+    for(auto& scene: verifyScenes(seed)){
+        candle::CompactEdgeVector compact(scene.edges.begin(), scene.edges.end());
+        candle::EdgeVector decoded(compact.begin(), compact.end());
+        for(size_t i = 0; i < scene.radial.size(); i++){
+            auto ref = radialReference(scene.edges, scene.circles, scene.radial[i]);
+            auto refDecoded = radialReference(decoded, scene.circles, scene.radial[i]);
+            for(auto& path: radialPaths(tolerance)){
+                if(path.quantized && !scene.circles.empty()){
+                    continue; // circles can't be quantized
+                }
+                auto got = path.cast(scene.edges, scene.circles, scene.radial[i]);
+                report(scene.name, path.name, "radial", i,
+                       compareRadial(path.quantized ? refDecoded : ref, got, scene.radial[i]));
+            }
+        }
+        for(size_t i = 0; i < scene.directed.size(); i++){
+            auto ref = directedReference(scene.edges, scene.directed[i]);
+            auto refDecoded = directedReference(decoded, scene.directed[i]);
+            for(auto& path: directedPaths()){
+                auto got = path.cast(scene.edges, scene.directed[i]);
+                report(scene.name, path.name, "directed", i,
+                       compareDirected(path.quantized ? refDecoded : ref, got, scene.directed[i]));
+            }
+        }
+    }
+    std::cout << checks - failures << "/" << checks << " polygons match the reference" << std::endl;
+    int segmentChecks = 0, segmentFailures = 0;
+    for(auto& scene: verifyScenes(seed)){
+        verifyEdgeGrid(scene, seed, segmentChecks, segmentFailures);
+    }
+    std::cout << segmentChecks - segmentFailures << "/" << segmentChecks
+              << " segments match the brute force" << std::endl;
+    return failures || segmentFailures ? 1 : 0;
+}
+
+/*
+ * COMMAND LINE
+ */
+template <typename T>
+std::vector<T> parseList(const std::string& s){
+    std::vector<T> ret;
+    std::stringstream ss(s);
+    std::string item;
+    while(std::getline(ss, item, ',')){
+        std::stringstream is(item);
+        T x;
+        if(is >> x) ret.push_back(x);
+    }
+    return ret;
+}
+
+void usage(){
+    std::cout
+        << "Usage: benchmark [options]\n"
+        << "  --edges N1,N2,...    Edge counts to sweep (default 100,...,1000000)\n"
+        << "  --scenes S1,S2,...   Scenes among random, grid, cave, sprawl (default\n"
+        << "                       all). sprawl has at least 4M edges\n"
+        << "  --lights N1,N2,...   Light counts for castLight (default 1,16)\n"
+        << "  --beams A1,A2,...    Beam angles of the radial lights (default 360,90,30)\n"
+        << "  --min-time SECONDS   Minimum time per case (default 0.25)\n"
+        << "  --max-work TESTS     Skip castLight cases estimated above this amount\n"
+        << "                       of intersection tests per iteration (default 2e9)\n"
+        << "  --seed N             Seed for the scenes (default 1)\n"
+        << "  --json FILE          Write the results to FILE as JSON\n"
+        << "  --trace FILE         Record a Chrome trace event timeline to FILE\n"
+        << "  --quick              Small sweep, for smoke testing\n"
+        << "  --verify             Instead of measuring, compare the polygons of\n"
+        << "                       all the cast paths and the EdgeGrid line of sight\n"
+        << "                       with a brute force reference and exit with 1 if\n"
+        << "                       any of them diverges\n"
+        << "  --tolerance D        Maximum distance allowed in --verify (default 0.5)\n"
+        << "  --threads N          Threads per RadialLight, 0 for all (default 1)\n";
+}
+
+int main(int argc, char* argv[]){
+    Options opt;
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(arg == "--help" || arg == "-h"){
+            usage();
+            return 0;
+        }else if(arg == "--quick"){
+            opt.edgeCounts = {100, 1000};
+            opt.scenes = {"random", "grid", "cave"};
+            opt.lightCounts = {1};
+            opt.minTime = 0.05;
+        }else if(arg == "--edges" && hasValue){
+            opt.edgeCounts = parseList<size_t>(argv[++i]);
+        }else if(arg == "--scenes" && hasValue){
+            opt.scenes = parseList<std::string>(argv[++i]);
+        }else if(arg == "--lights" && hasValue){
+            opt.lightCounts = parseList<int>(argv[++i]);
+        }else if(arg == "--beams" && hasValue){
+            opt.beamAngles = parseList<float>(argv[++i]);
+        }else if(arg == "--min-time" && hasValue){
+            opt.minTime = std::atof(argv[++i]);
+        }else if(arg == "--max-work" && hasValue){
+            opt.maxWork = std::atof(argv[++i]);
+        }else if(arg == "--seed" && hasValue){
+            opt.seed = std::atoi(argv[++i]);
+        }else if(arg == "--json" && hasValue){
+            opt.json = argv[++i];
+        }else if(arg == "--trace" && hasValue){
+            opt.trace = argv[++i];
+        }else if(arg == "--verify"){
+            opt.verify = true;
+        }else if(arg == "--tolerance" && hasValue){
+            opt.tolerance = std::atof(argv[++i]);
+        }else if(arg == "--threads" && hasValue){
+            opt.threads = std::atoi(argv[++i]);
+        }else{
+            std::cerr << "Unknown option " << arg << std::endl;
+            usage();
+            return 1;
+        }
+    }
+
+    if(opt.verify){
+        return verify(opt.seed, opt.tolerance);
+    }
+
+    std::cout << std::left << std::setw(26) << "benchmark"
+              << std::setw(8) << "scene"
+              << std::right << std::setw(9) << "edges"
+              << std::setw(5) << "lgts"
+              << std::setw(6) << "beam"
+              << std::setw(14) << "ns/ray"
+              << std::setw(16) << "rays/s"
+              << std::setw(12) << "allocs/it" << std::endl;
+
+    if(!opt.trace.empty() && !candle::startTrace(opt.trace)){
+        std::cerr << "Could not write " << opt.trace << std::endl;
+        return 1;
+    }
+
+    std::vector<Result> results;
+    for(auto& sceneName: opt.scenes){
+        for(size_t n: opt.edgeCounts){
+            if(sceneName == "sprawl" && n < SPRAWL_EDGES && n != opt.edgeCounts.front()){
+                continue; // same scene as with the first count
+            }
+            Scene scene = makeScene(sceneName, n, opt.seed);
+            candle::CompactEdgeVector compact(scene.edges.begin(), scene.edges.end());
+            size_t first = results.size();
+            benchIntersection(scene, opt, results);
+            benchCastRay(scene, opt, results);
+            benchCastRayCompact(scene, compact, opt, results);
+            for(int lights: opt.lightCounts){
+                for(float beam: opt.beamAngles){
+                    benchRadial(scene, nullptr, opt, lights, beam, results);
+                    benchRadial(scene, &compact, opt, lights, beam, results);
+                }
+                benchDirected(scene, nullptr, opt, lights, results);
+                benchDirected(scene, &compact, opt, lights, results);
+            }
+            for(size_t i = first; i < results.size(); i++){
+                printResult(results[i]);
+            }
+            candle::flushTrace();
+        }
+    }
+
+    if(!opt.trace.empty()){
+        std::uint64_t dropped = candle::stopTrace();
+        std::cout << "Timeline written to " << opt.trace;
+        if(dropped > 0){
+            std::cout << " (" << dropped << " events dropped)";
+        }
+        std::cout << std::endl;
+    }
+
+    if(!opt.json.empty()){
+        if(!writeJson(opt.json, opt, results)){
+            std::cerr << "Could not write " << opt.json << std::endl;
+            return 1;
+        }
+        std::cout << "Results written to " << opt.json << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,232 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the BitGrid class.
+ */
+#ifndef __CANDLE_BIT_GRID_HPP__
+#define __CANDLE_BIT_GRID_HPP__
+
+#include <cstdint>
+#include <vector>
+
+#include "SFML/Graphics.hpp"
+
+#include "Candle/LightSource.hpp"
+
+namespace candle{
+    /**
+     * @brief Grid of cells of an area of the world with one bit per cell.
+     * @details
+     *
+     * Every row of the grid is stored in 64 bit words, so spans of cells
+     * are set a whole word at a time, and grids of the same size are
+     * combined and counted word by word.
+     *
+     * Polygons are rasterized with @ref fillPolygon: a cell is set if its
+     * center is inside the polygon. Rasterization doesn't need a graphics
+     * context.
+     */
+    class BitGrid{
+    private:
+        sf::FloatRect m_area;
+        float m_cellSize;
+        unsigned int m_width;
+        unsigned int m_height;
+        size_t m_rowWords;
+        std::vector<std::uint64_t> m_words;
+
+        void fill(const sf::Vector2f* points, size_t count, unsigned int rowBegin, unsigned int rowEnd,
+                  const sf::Vector2f& clipCenter, float clipRadius);
+
+    public:
+        /**
+         * @brief Constructor of an empty grid, with no cells.
+         */
+        BitGrid();
+
+        /**
+         * @brief Constructor.
+         * @param area Area of the world covered by the grid.
+         * @param cellSize Side of the cells, in world units.
+         */
+        BitGrid(const sf::FloatRect& area, float cellSize);
+
+        /**
+         * @brief Change the area and the size of the cells, and unset all
+         * the cells.
+         * @param area Area of the world covered by the grid.
+         * @param cellSize Side of the cells, in world units.
+         */
+        void reset(const sf::FloatRect& area, float cellSize);
+
+        /**
+         * @brief Get the area of the world covered by the grid.
+         */
+        const sf::FloatRect& getArea() const;
+
+        /**
+         * @brief Get the side of the cells.
+         */
+        float getCellSize() const;
+
+        /**
+         * @brief Get the number of columns.
+         */
+        unsigned int getWidth() const;
+
+        /**
+         * @brief Get the number of rows.
+         */
+        unsigned int getHeight() const;
+
+        /**
+         * @brief Get the cell that contains a point.
+         * @details The result may be out of the grid.
+         * @param point Point in global coordinates.
+         * @returns Column and row of the cell.
+         */
+        sf::Vector2i getCell(const sf::Vector2f& point) const;
+
+        /**
+         * @brief Check if a cell is set.
+         * @details Cells out of the grid are never set.
+         * @param x Column.
+         * @param y Row.
+         */
+        bool get(int x, int y) const;
+
+        /**
+         * @brief Check if the cell that contains a point is set.
+         * @param point Point in global coordinates.
+         */
+        bool contains(const sf::Vector2f& point) const;
+
+        /**
+         * @brief Set or unset a cell of the grid.
+         * @param x Column.
+         * @param y Row.
+         * @param value
+         */
+        void set(unsigned int x, unsigned int y, bool value = true);
+
+        /**
+         * @brief Set the cells [@p x0, @p x1) of a row.
+         * @param y Row.
+         * @param x0 First column.
+         * @param x1 Column past the last one.
+         */
+        void fillSpan(unsigned int y, unsigned int x0, unsigned int x1);
+
+        /**
+         * @brief Set the cells whose center is inside a polygon.
+         * @details The polygon is filled with the even-odd rule, so a
+         * polygon that goes back along one of its sides doesn't fill it. Only
+         * the rows in [@p rowBegin, @p rowEnd) are modified, so several
+         * threads can fill the same grid by rows.
+         * @param points Vertices of the polygon, in global coordinates.
+         * @param count Number of vertices.
+         * @param rowBegin First row to fill.
+         * @param rowEnd Row past the last one to fill.
+         */
+        void fillPolygon(const sf::Vector2f* points, size_t count,
+                         unsigned int rowBegin = 0, unsigned int rowEnd = ~0u);
+
+        /**
+         * @brief Set the cells lit by a light.
+         * @details The polygon of the last cast of the light is filled,
+         * following its primitive type (see @ref LightSource::getPolygon).
+         * Triangle fans, like the ones of @ref RadialLight, are filled as
+         * the polygon of their vertices, clipped to the circle of the range
+         * of the light. Only the rows in [@p rowBegin, @p rowEnd) are
+         * modified.
+         * @param light Light already casted.
+         * @param rowBegin First row to fill.
+         * @param rowEnd Row past the last one to fill.
+         */
+        void fillLight(const LightSource& light, unsigned int rowBegin = 0, unsigned int rowEnd = ~0u);
+
+        /**
+         * @brief Set the cells lit by any of several lights.
+         * @details The rows of the grid are split among threads, and every
+         * thread fills its rows with all the lights that reach them, so the
+         * union doesn't need to merge intermediate grids. After this call,
+         * the grid holds the region lit by the lights and
+         * @ref getCoveredArea its area.
+         * @param lights Lights already casted.
+         * @param threads Maximum number of threads. Zero means one per
+         * hardware thread.
+         * @see fillLight
+         */
+        void fillLights(const std::vector<const LightSource*>& lights, unsigned int threads = 0);
+
+        /**
+         * @brief Set the cells lit by several lights, each one in its own
+         * grid.
+         * @details Like the other overload, but every light is filled in
+         * the grid at its index in @p grids, so several grids, like the ones
+         * of the teams of a @ref TeamVisibility, are filled in a single pass
+         * over their rows. The grids must have the same area and cell size.
+         * @param lights Lights already casted.
+         * @param grids Grid of each light.
+         * @param threads Maximum number of threads. Zero means one per
+         * hardware thread.
+         */
+        static void fillLights(const std::vector<const LightSource*>& lights,
+                               const std::vector<BitGrid*>& grids, unsigned int threads = 0);
+
+        /**
+         * @brief Unset all the cells.
+         */
+        void clear();
+
+        /**
+         * @brief Set the cells set in another grid of the same size.
+         * @param other
+         */
+        void merge(const BitGrid& other);
+
+        /**
+         * @brief Unset the cells set in another grid of the same size.
+         * @param other
+         */
+        void subtract(const BitGrid& other);
+
+        /**
+         * @brief Get the number of cells set.
+         */
+        size_t count() const;
+
+        /**
+         * @brief Get the area of the cells set, in world units.
+         * @details It is the number of cells set times the area of a cell.
+         */
+        float getCoveredArea() const;
+
+        /**
+         * @brief Check if any cell set overlaps an area.
+         * @param area Area of the world.
+         * @returns True if a cell that overlaps @p area is set.
+         */
+        bool intersects(const sf::FloatRect& area) const;
+
+        /**
+         * @brief Append the cells set to a vector.
+         * @param out Vector to append the column and row of the cells to.
+         */
+        void getCells(std::vector<sf::Vector2u>& out) const;
+
+        /**
+         * @brief Get the number of words of every row.
+         */
+        size_t getRowWords() const;
+
+        /**
+         * @brief Get the words of the grid, row by row.
+         * @details The bit i of the word j of a row is the cell 64*j + i.
+         */
+        const std::vector<std::uint64_t>& getWords() const;
+    };
+}
+
+#endif
@@ -11,5 +11,15 @@
 #include "Candle/RadialLight.hpp"
 #include "Candle/DirectedLight.hpp"
 #include "Candle/LightingArea.hpp"
+#include "Candle/LightScheduler.hpp"
+#include "Candle/CompactEdgeVector.hpp"
+#include "Candle/EdgeDatabase.hpp"
+#include "Candle/BitGrid.hpp"
+#include "Candle/TeamVisibility.hpp"
+#include "Candle/EdgeGrid.hpp"
+#include "Candle/OccluderGenerator.hpp"
+#include "Candle/DynamicEdgeGrid.hpp"
+#include "Candle/Statistics.hpp"
+#include "Candle/Trace.hpp"
 
 #endif
@@ -0,0 +1,233 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the CompactEdgeVector class.
+ */
+#ifndef __CANDLE_COMPACT_EDGE_VECTOR_HPP__
+#define __CANDLE_COMPACT_EDGE_VECTOR_HPP__
+
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include "SFML/Graphics/Rect.hpp"
+
+#include "Candle/geometry/Line.hpp"
+
+namespace candle{
+    /**
+     * @brief Edge pool that stores the endpoints quantized to 16 bits.
+     * @details
+     *
+     * The edges are grouped in square chunks of the world, by the position
+     * of their middle point. The endpoints of every edge are stored as
+     * int16 offsets from the center of its chunk, multiplied by a scale of
+     * the chunk, so an edge takes 8 bytes instead of the 16 of a
+     * @ref sfu::Line.
+     *
+     * The scale of a chunk is the smallest power of two that fits all its
+     * endpoints, so each coordinate is decoded with an error of at most half
+     * the scale (see @ref getMaxError), and points on the grid of the scale
+     * (like integer coordinates in chunks under 65536 units) are exact. With
+     * the default chunk size of 1024 units and edges shorter than the
+     * chunks, the scale is at most 1/16 and the error at most 0.044 units.
+     *
+     * The edges are decoded on the fly: the iterators of the vector return
+     * @ref sfu::Line values, so they can be passed to @ref sfu::castRay.
+     * An iterator can also skip the chunks out of an area (see
+     * @ref begin(const sf::FloatRect&) const), which is how
+     * @ref LightSource::castLight(const CompactEdgeVector&) only reads the
+     * chunks in the bounds of the light, without copying them.
+     *
+     * Note that the edges are reordered by chunk.
+     */
+    class CompactEdgeVector{
+    public:
+        /**
+         * @brief Quantized edge.
+         */
+        struct CompactEdge{
+            std::int16_t x1, y1, x2, y2;
+        };
+
+        /**
+         * @brief Group of edges with a common origin and scale.
+         */
+        struct Chunk{
+            sf::Vector2f origin; ///< Point decoded from the offset (0, 0).
+            float scale; ///< Units of the world per unit of the offsets.
+            sf::FloatRect bounds; ///< Bounding rectangle of the decoded edges.
+            size_t begin; ///< Index of the first edge of the chunk.
+            size_t end; ///< Index past the last edge of the chunk.
+        };
+
+        /**
+         * @brief Input iterator that decodes the edges.
+         * @details It may skip the chunks that don't intersect an area.
+         *
+         * The edges are decoded on access and returned by value, so the
+         * iterator can't give references to them, which a forward iterator
+         * must. Copies of an iterator are independent, though, so a range
+         * can be walked again from a copy of its beginning, like the casts
+         * of the lights do.
+         */
+        class const_iterator{
+        private:
+            const CompactEdgeVector* m_vector;
+            size_t m_index;
+            size_t m_chunk;
+            sf::FloatRect m_area;
+            bool m_culled;
+
+            void skipChunks();
+
+        public:
+            typedef std::input_iterator_tag iterator_category;
+            typedef sfu::Line value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const sfu::Line* pointer;
+            typedef sfu::Line reference;
+
+            /**
+             * @brief Holds a decoded edge so it can be accessed with ->.
+             */
+            struct Proxy{
+                sfu::Line edge;
+                const sfu::Line* operator->() const{ return &edge; }
+            };
+
+            const_iterator(const CompactEdgeVector* v, size_t index, size_t chunk);
+            const_iterator(const CompactEdgeVector* v, size_t index, size_t chunk, const sf::FloatRect& area);
+
+            sfu::Line operator*() const;
+            Proxy operator->() const;
+            const_iterator& operator++();
+            const_iterator operator++(int);
+            bool operator==(const const_iterator& other) const;
+            bool operator!=(const const_iterator& other) const;
+        };
+
+    private:
+        std::vector<CompactEdge> m_edges;
+        std::vector<Chunk> m_chunks;
+        float m_chunkSize;
+
+    public:
+        /**
+         * @brief Constructor.
+         * @param chunkSize Side of the chunks, in world units.
+         */
+        explicit CompactEdgeVector(float chunkSize = 1024.f);
+
+        /**
+         * @brief Construct the vector from a range of edges.
+         * @param begin Iterator to the first edge.
+         * @param end Iterator past the last edge.
+         * @param chunkSize Side of the chunks, in world units.
+         */
+        template <typename Iterator>
+        CompactEdgeVector(const Iterator& begin, const Iterator& end, float chunkSize = 1024.f)
+            : m_chunkSize(chunkSize)
+        {
+            assign(std::vector<sfu::Line>(begin, end));
+        }
+
+        /**
+         * @brief Replace the content of the vector with some edges.
+         * @param edges
+         */
+        void assign(const std::vector<sfu::Line>& edges);
+
+        /**
+         * @brief Remove all the edges.
+         */
+        void clear();
+
+        /**
+         * @brief Get the number of edges.
+         */
+        size_t size() const;
+
+        /**
+         * @brief Check if there are no edges.
+         */
+        bool empty() const;
+
+        /**
+         * @brief Get the side of the chunks.
+         */
+        float getChunkSize() const;
+
+        /**
+         * @brief Get the chunks of the vector.
+         */
+        const std::vector<Chunk>& getChunks() const;
+
+        /**
+         * @brief Get the quantized edges, ordered by chunk.
+         */
+        const std::vector<CompactEdge>& getCompactEdges() const;
+
+        /**
+         * @brief Decode an edge.
+         * @param chunk Index of the chunk of the edge.
+         * @param index Index of the edge.
+         * @returns The decoded edge.
+         */
+        sfu::Line decode(size_t chunk, size_t index) const;
+
+        /**
+         * @brief Decode a quantized edge of a chunk.
+         * @param chunk Chunk of the edge.
+         * @param edge Quantized edge.
+         * @returns The decoded edge.
+         */
+        static sfu::Line decode(const Chunk& chunk, const CompactEdge& edge);
+
+        /**
+         * @brief Decode the edges of the chunks that intersect an area.
+         * @details The edges are appended to @p out. Some of them may be out
+         * of the area, but all the ones that intersect it are decoded.
+         * @param area Area of the world.
+         * @param out Vector to append the edges to.
+         */
+        void decode(const sf::FloatRect& area, std::vector<sfu::Line>& out) const;
+
+        /**
+         * @brief Get the maximum distance between an endpoint and its
+         * decoded value.
+         * @details It is half the diagonal of a quantization step of the
+         * chunk with the greatest scale.
+         * @returns The precision bound, in world units.
+         */
+        float getMaxError() const;
+
+        /**
+         * @brief Get the number of bytes used to store the edges and chunks.
+         */
+        size_t getMemoryUsage() const;
+
+        /**
+         * @brief Get an iterator to the first edge.
+         */
+        const_iterator begin() const;
+
+        /**
+         * @brief Get an iterator to the first edge of the chunks that
+         * intersect an area.
+         * @details The iterator skips the chunks that don't intersect the
+         * area, so the range up to @ref end has the same edges as
+         * @ref decode(const sf::FloatRect&, std::vector<sfu::Line>&) const.
+         * @param area Area of the world.
+         */
+        const_iterator begin(const sf::FloatRect& area) const;
+
+        /**
+         * @brief Get an iterator past the last edge.
+         */
+        const_iterator end() const;
+    };
+}
+
+#endif
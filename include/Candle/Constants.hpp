@@ -2,7 +2,8 @@
  * @file
  * @author Miguel Mejía Jiménez
  * @copyright MIT License
- * @brief This file contains constants for internal use in Candle.
+ * @brief This file contains constants and helpers for internal use in
+ * Candle.
  */
 #ifndef __CANDLE_CONSTANTS_HPP__
 #define __CANDLE_CONSTANTS_HPP__
@@ -14,4 +15,13 @@ namespace sfu{
     extern const float PI;
 }
 
+namespace candle{
+    /**
+     * Key of the cell (x, y) of a sparse grid: the low 32 bits of x, then
+     * the low 32 bits of y. The shift is done unsigned, so the cells with
+     * negative coordinates have well defined keys.
+     */
+    long long cellKey(long long x, long long y);
+}
+
 #endif
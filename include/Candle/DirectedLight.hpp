@@ -35,10 +35,16 @@ namespace candle{
         
         void draw(sf::RenderTarget& t, sf::RenderStates st) const override;
         void resetColor() override;
+        std::unique_ptr<LightSource> clone() const override;
+        template <typename Iterator>
+        void cast(const Iterator& begin, const Iterator& end);
     public:
         DirectedLight();
         
         void castLight(const EdgeVector::iterator& begin, const EdgeVector::iterator& end) override;
+        void castLight(const CompactEdgeVector::const_iterator& begin,
+                       const CompactEdgeVector::const_iterator& end) override;
+        using LightSource::castLight;
         
         /**
          * @brief Set the width of the beam.
@@ -57,6 +63,20 @@ namespace candle{
          */
         float getBeamWidth() const;
         
+        /**
+         * @brief Get the local bounding rectangle of the light.
+         * @details It bounds the beam: from the source to the range along the
+         * direction of the light, and the beam width across it.
+         * @returns The local bounding rectangle in float.
+         */
+        sf::FloatRect getLocalBounds() const override;
+        
+        /**
+         * @brief Get the global bounding rectangle of the light.
+         * @returns The global bounding rectangle in float.
+         */
+        sf::FloatRect getGlobalBounds() const override;
+        
     };
 }
 
@@ -0,0 +1,164 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the DynamicEdgeGrid class.
+ */
+#ifndef __CANDLE_DYNAMIC_EDGE_GRID_HPP__
+#define __CANDLE_DYNAMIC_EDGE_GRID_HPP__
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "SFML/Graphics.hpp"
+
+#include "Candle/LightSource.hpp"
+
+namespace candle{
+    class LightScheduler;
+
+    /**
+     * @brief Edge pool with handles to move single edges, indexed by a loose
+     * grid.
+     * @details
+     *
+     * Doors, elevators or crates move a few edges every frame. Instead of
+     * rebuilding the whole pool, every edge is inserted once and gets a
+     * handle, which can be used to update or remove it. Each change costs
+     * O(1): the edges are kept in the cell that contains the center of their
+     * bounds, and they only move to another cell when their center does.
+     *
+     * The grid is loose: a cell holds edges that stick out of it up to one
+     * cell, so queries look one cell further. Longer edges are kept apart and
+     * checked in every query, so the grid works best with edges shorter than
+     * the cells.
+     *
+     * If a @ref LightScheduler is attached with @ref setScheduler, every
+     * change marks dirty the lights whose bounds touch the old or the new
+     * edge, with @ref LightScheduler::markDirty(const sf::FloatRect&), and
+     * @ref LightScheduler::update(const DynamicEdgeGrid&, const sf::View&)
+     * casts them with the grid.
+     *
+     * Lights are casted with @ref LightSource::castLight(const DynamicEdgeGrid&),
+     * which only takes the edges near the bounds of the light.
+     */
+    class DynamicEdgeGrid{
+    public:
+        /**
+         * @brief Identifier of an edge of the grid.
+         */
+        typedef std::uint32_t Handle;
+
+        /**
+         * @brief Value of a handle that doesn't identify any edge.
+         */
+        static const Handle INVALID_HANDLE = ~Handle(0);
+
+    private:
+        struct Slot{
+            sfu::Line edge;
+            long long cell;
+            std::uint32_t index; // in the cell or in the long edges
+            bool used;
+        };
+        float m_cellSize;
+        std::vector<Slot> m_slots;
+        std::vector<Handle> m_free;
+        std::unordered_map<long long, std::vector<Handle>> m_cells;
+        std::vector<Handle> m_long;
+        size_t m_size;
+        LightScheduler* m_scheduler;
+
+        long long cellOf(const sfu::Line& edge) const;
+        std::vector<Handle>& bucket(long long cell);
+        void link(Handle handle);
+        void unlink(Handle handle);
+        void changed(const sf::FloatRect& area);
+
+    public:
+        /**
+         * @brief Constructor.
+         * @param cellSize Side of the cells, in world units.
+         */
+        explicit DynamicEdgeGrid(float cellSize = 64.f);
+
+        /**
+         * @brief Insert an edge.
+         * @param edge
+         * @returns The handle of the edge.
+         */
+        Handle insert(const sfu::Line& edge);
+
+        /**
+         * @brief Replace an edge.
+         * @param handle Handle of the edge.
+         * @param edge New value of the edge.
+         * @returns False if the handle doesn't identify an edge.
+         */
+        bool update(Handle handle, const sfu::Line& edge);
+
+        /**
+         * @brief Remove an edge.
+         * @details The handle may be given to an edge inserted later.
+         * @param handle Handle of the edge.
+         * @returns False if the handle doesn't identify an edge.
+         */
+        bool remove(Handle handle);
+
+        /**
+         * @brief Check if a handle identifies an edge.
+         * @param handle
+         */
+        bool contains(Handle handle) const;
+
+        /**
+         * @brief Get an edge.
+         * @param handle Handle of an edge of the grid.
+         */
+        const sfu::Line& get(Handle handle) const;
+
+        /**
+         * @brief Get the number of edges.
+         */
+        size_t size() const;
+
+        /**
+         * @brief Remove all the edges.
+         * @details The attached scheduler, if any, marks all its lights
+         * dirty.
+         */
+        void clear();
+
+        /**
+         * @brief Get the side of the cells.
+         */
+        float getCellSize() const;
+
+        /**
+         * @brief Get the edges near an area.
+         * @details The edges are appended to @p out, each one once. Some of
+         * them may be out of the area, but all the ones that intersect it
+         * are included.
+         * @param area Area of the world.
+         * @param out Vector to append the edges to.
+         */
+        void query(const sf::FloatRect& area, EdgeVector& out) const;
+
+        /**
+         * @brief Set the scheduler whose lights are marked dirty by the
+         * changes.
+         * @param scheduler Scheduler to notify, or nullptr for none.
+         */
+        void setScheduler(LightScheduler* scheduler);
+
+        /**
+         * @brief Get the scheduler whose lights are marked dirty by the
+         * changes.
+         * @see setScheduler
+         */
+        LightScheduler* getScheduler() const;
+    };
+}
+
+#endif
@@ -0,0 +1,198 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the EdgeDatabase class.
+ */
+#ifndef __CANDLE_EDGE_DATABASE_HPP__
+#define __CANDLE_EDGE_DATABASE_HPP__
+
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "SFML/Graphics.hpp"
+
+#include "Candle/CompactEdgeVector.hpp"
+#include "Candle/LightSource.hpp"
+
+namespace candle{
+    /**
+     * @brief Edge source backed by a chunked file mapped in memory.
+     * @details
+     *
+     * Worlds too big to keep all their edges in an @ref EdgeVector can be
+     * written once to a file with @ref write and then opened as an
+     * EdgeDatabase. The file is divided in square chunks of the world with
+     * quantized edges (see @ref CompactEdgeVector), and it is mapped in
+     * memory, so the operating system only reads the chunks that are used.
+     *
+     * Edges are requested by area, with @ref query, or for a light, with
+     * @ref LightSource::castLight(EdgeDatabase&), which only decodes the
+     * chunks that overlap the bounds of the light. The decoded chunks are
+     * kept in a LRU cache of @ref setCacheSize chunks, and
+     * @ref updateCamera prefetches in a worker thread the chunks the camera
+     * is moving towards.
+     *
+     * All the functions can be called while a prefetch is running.
+     */
+    class EdgeDatabase{
+    private:
+        struct MappedFile;
+        struct ChunkEntry{
+            CompactEdgeVector::Chunk chunk;
+            std::uint64_t offset;
+        };
+        typedef std::shared_ptr<const EdgeVector> ChunkEdges;
+        struct CacheEntry{
+            ChunkEdges edges;
+            std::list<size_t>::iterator position;
+        };
+
+        std::unique_ptr<MappedFile> m_file;
+        float m_chunkSize;
+        std::vector<ChunkEntry> m_chunks;
+        // chunks whose bounds overlap each cell of the grid of chunkSize
+        std::unordered_map<long long, std::vector<size_t>> m_grid;
+
+        mutable std::mutex m_cacheMutex;
+        std::list<size_t> m_lru; // most recently used first
+        std::unordered_map<size_t, CacheEntry> m_cache;
+        size_t m_cacheSize;
+        unsigned long m_hits;
+        unsigned long m_misses;
+
+        std::future<void> m_prefetch;
+        bool m_hasCamera;
+        sf::Vector2f m_lastCamera;
+        float m_lookAhead;
+
+        std::vector<size_t> chunksIn(const sf::FloatRect& area) const;
+        ChunkEdges load(size_t chunk, bool count);
+        ChunkEdges decode(size_t chunk) const;
+
+    public:
+        /**
+         * @brief Write some edges to a file that can be opened as an
+         * EdgeDatabase.
+         * @param path Path of the file to write.
+         * @param begin Iterator to the first edge.
+         * @param end Iterator past the last edge.
+         * @param chunkSize Side of the chunks, in world units.
+         * @returns True if the file could be written.
+         */
+        static bool write(const std::string& path, const EdgeVector::const_iterator& begin,
+                          const EdgeVector::const_iterator& end, float chunkSize = 1024.f);
+
+        /**
+         * @brief Constructor.
+         * @details By default, the cache keeps 64 chunks and the prefetch looks
+         * 30 frames ahead.
+         */
+        EdgeDatabase();
+
+        /**
+         * @brief Destructor.
+         * @details It waits for the pending prefetch.
+         */
+        ~EdgeDatabase();
+
+        EdgeDatabase(const EdgeDatabase&) = delete;
+        EdgeDatabase& operator=(const EdgeDatabase&) = delete;
+
+        /**
+         * @brief Map a file written with @ref write.
+         * @details Any previously opened file is closed.
+         * @param path Path of the file.
+         * @returns True if the file could be opened and is valid.
+         */
+        bool open(const std::string& path);
+
+        /**
+         * @brief Unmap the file and clear the cache.
+         */
+        void close();
+
+        /**
+         * @brief Check if there is a file opened.
+         */
+        bool isOpen() const;
+
+        /**
+         * @brief Get the number of chunks of the file.
+         */
+        size_t getChunkCount() const;
+
+        /**
+         * @brief Get the side of the chunks of the file.
+         */
+        float getChunkSize() const;
+
+        /**
+         * @brief Get the edges of the chunks that overlap an area.
+         * @details The edges are appended to @p out. Some of them may be out
+         * of the area, but all the ones that intersect it are included.
+         * @param area Area of the world.
+         * @param out Vector to append the edges to.
+         */
+        void query(const sf::FloatRect& area, EdgeVector& out);
+
+        /**
+         * @brief Load in the cache, in a worker thread, the chunks that
+         * overlap an area.
+         * @details If a prefetch is already running, this call is ignored.
+         * The job runs in the background workers of the library (see
+         * @ref runAsync). At most half the cache is prefetched, taking
+         * first the chunks that come first along @p direction, or the ones
+         * nearest to the center of the area if it is zero.
+         * @param area Area of the world.
+         * @param direction Direction the chunks will be needed in, like the
+         * velocity of the camera.
+         */
+        void prefetch(const sf::FloatRect& area, const sf::Vector2f& direction = sf::Vector2f());
+
+        /**
+         * @brief Prefetch the chunks the camera is moving towards.
+         * @details It is meant to be called once per frame. The velocity of
+         * the camera is estimated from the previous call, and the area shown
+         * by the view, moved as many frames ahead as the look-ahead, is
+         * prefetched along the velocity.
+         * @param view Current view of the camera.
+         * @see setLookAhead
+         */
+        void updateCamera(const sf::View& view);
+
+        /**
+         * @brief Set how many frames ahead of the camera to prefetch.
+         * @param frames
+         */
+        void setLookAhead(float frames);
+
+        /**
+         * @brief Set the maximum number of decoded chunks kept in memory.
+         * @param chunks
+         */
+        void setCacheSize(size_t chunks);
+
+        /**
+         * @brief Get the maximum number of decoded chunks kept in memory.
+         */
+        size_t getCacheSize() const;
+
+        /**
+         * @brief Get the number of chunks found in the cache by @ref query.
+         */
+        unsigned long getCacheHits() const;
+
+        /**
+         * @brief Get the number of chunks @ref query had to decode.
+         */
+        unsigned long getCacheMisses() const;
+    };
+}
+
+#endif
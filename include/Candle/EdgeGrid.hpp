@@ -0,0 +1,139 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the EdgeGrid class.
+ */
+#ifndef __CANDLE_EDGE_GRID_HPP__
+#define __CANDLE_EDGE_GRID_HPP__
+
+#include <cstdint>
+#include <vector>
+
+#include "SFML/Graphics.hpp"
+
+#include "Candle/LightSource.hpp"
+
+namespace candle{
+    /**
+     * @brief Edge pool indexed by a uniform grid, for line of sight
+     * queries.
+     * @details
+     *
+     * Every cell of the grid keeps the edges whose bounding rectangle
+     * overlaps it, so a segment only needs to be tested against the edges of
+     * the cells it crosses, which are walked in order from its origin.
+     *
+     * @ref intersects answers if any edge blocks a segment, stopping at the
+     * first one found, and its batched version splits an array of segments
+     * across threads. Lights can be casted with the edges of the grid too,
+     * with @ref LightSource::castLight(const EdgeGrid&), which only takes the
+     * edges in the cells of the bounds of the light.
+     *
+     * The grid is built once with @ref assign, so it is meant for the
+     * static edges of a level.
+     */
+    class EdgeGrid{
+    private:
+        EdgeVector m_edges;
+        float m_requestedCellSize;
+        float m_cellSize; // the requested one, enlarged for big areas
+        sf::Vector2f m_origin;
+        unsigned int m_width;
+        unsigned int m_height;
+        // the edges of the cell i are m_cellEdges[m_cellStart[i]..m_cellStart[i+1])
+        std::vector<std::uint32_t> m_cellStart;
+        std::vector<std::uint32_t> m_cellEdges;
+        unsigned int m_threads;
+
+        template <typename F>
+        bool walk(const sfu::Line& segment, F f) const;
+
+    public:
+        /**
+         * @brief Constructor.
+         * @param cellSize Side of the cells, in world units.
+         */
+        explicit EdgeGrid(float cellSize = 64.f);
+
+        /**
+         * @brief Construct the grid from a range of edges.
+         * @param begin Iterator to the first edge.
+         * @param end Iterator past the last edge.
+         * @param cellSize Side of the cells, in world units.
+         */
+        EdgeGrid(const EdgeVector::const_iterator& begin, const EdgeVector::const_iterator& end,
+                 float cellSize = 64.f);
+
+        /**
+         * @brief Replace the edges of the grid.
+         * @details The grid covers the bounds of the edges. If it would have
+         * more than a million cells, the cells are made bigger, only for
+         * these edges: the next call starts again from the size given to the
+         * constructor.
+         * @param begin Iterator to the first edge.
+         * @param end Iterator past the last edge.
+         */
+        void assign(const EdgeVector::const_iterator& begin, const EdgeVector::const_iterator& end);
+
+        /**
+         * @brief Get the edges of the grid.
+         */
+        const EdgeVector& getEdges() const;
+
+        /**
+         * @brief Get the side of the cells.
+         * @details It is the one given to the constructor, unless the
+         * last @ref assign had to make the cells bigger.
+         */
+        float getCellSize() const;
+
+        /**
+         * @brief Get the edges of the cells that overlap an area.
+         * @details The edges are appended to @p out, each one once. Some of
+         * them may be out of the area, but all the ones that intersect it
+         * are included.
+         * @param area Area of the world.
+         * @param out Vector to append the edges to.
+         */
+        void query(const sf::FloatRect& area, EdgeVector& out) const;
+
+        /**
+         * @brief Check if any edge intersects a segment.
+         * @details Edges parallel to the segment are not considered to
+         * intersect it, like in @ref sfu::castRay.
+         * @param segment Segment from its origin to origin + direction.
+         * @returns True if the segment is blocked.
+         */
+        bool intersects(const sfu::Line& segment) const;
+
+        /**
+         * @brief Check for several segments if any edge intersects them.
+         * @details The segments are split among threads (see
+         * @ref setThreadCount).
+         * @param segments Segments to check, each one from its origin to
+         * origin + direction.
+         * @param blocked Output: 1 for the segments blocked by an edge, 0 for
+         * the rest. It is resized to the number of segments.
+         */
+        void intersects(const std::vector<sfu::Line>& segments, std::vector<char>& blocked) const;
+
+        /**
+         * @brief Set the number of threads used by the batched
+         * @ref intersects.
+         * @details Zero means one per hardware thread, which is the
+         * default. Small batches are checked in the calling thread.
+         * @param threads
+         */
+        void setThreadCount(unsigned int threads);
+
+        /**
+         * @brief Get the number of threads used by the batched
+         * @ref intersects.
+         * @see setThreadCount
+         */
+        unsigned int getThreadCount() const;
+    };
+}
+
+#endif
@@ -0,0 +1,194 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the LightScheduler class.
+ */
+#ifndef __CANDLE_LIGHT_SCHEDULER_HPP__
+#define __CANDLE_LIGHT_SCHEDULER_HPP__
+
+#include <functional>
+#include <vector>
+
+#include "SFML/Graphics.hpp"
+
+#include "Candle/LightSource.hpp"
+
+namespace candle{
+    /**
+     * @brief Spreads the calls to @ref LightSource::castLight over several
+     * frames.
+     * @details
+     *
+     * The scheduler keeps a list of lights and which of them are dirty, this
+     * is, whose polygon doesn't match the current state of the world. Every
+     * frame, @ref update recasts the dirty lights, the most important first,
+     * until the budget of the frame is spent. The rest keep their previous
+     * polygon until their turn comes.
+     *
+     * The priority of a dirty light grows with the fraction of the view it
+     * covers and with the number of frames it has been waiting, and it
+     * decreases with its distance to the center of the view. Lights that are
+     * not visible are never casted, but they stay dirty until they are.
+     *
+     * A light is marked dirty when it is added, when it is moved, rotated,
+     * scaled or its range changes (detected by the scheduler) and when the
+     * user calls one of the @ref markDirty functions, for example after
+     * modifying the edges.
+     *
+     * The scheduler doesn't own the lights; they must outlive it or be
+     * removed before being destroyed.
+     */
+    class LightScheduler{
+    private:
+        struct Entry{
+            LightSource* light;
+            bool dirty;
+            unsigned int staleFrames;
+            sf::Transform transform;
+            float range;
+        };
+        std::vector<Entry> m_entries;
+        sf::Time m_timeBudget;
+        unsigned long m_rayBudget;
+        float m_staleWeight;
+
+        Entry* find(const LightSource* light);
+        const Entry* find(const LightSource* light) const;
+        unsigned int schedule(const sf::View& view, const std::function<void(LightSource&)>& cast);
+
+    public:
+        /**
+         * @brief Constructor.
+         * @details By default, the budget is 4 milliseconds and there is no
+         * ray budget.
+         */
+        LightScheduler();
+
+        /**
+         * @brief Add a light to the scheduler, marked as dirty.
+         * @details Adding a light twice has no effect.
+         * @param light
+         */
+        void addLight(LightSource* light);
+
+        /**
+         * @brief Remove a light from the scheduler.
+         * @param light
+         */
+        void removeLight(const LightSource* light);
+
+        /**
+         * @brief Remove all the lights from the scheduler.
+         */
+        void clear();
+
+        /**
+         * @brief Get the number of lights in the scheduler.
+         */
+        size_t getLightCount() const;
+
+        /**
+         * @brief Get the number of lights waiting to be casted.
+         */
+        size_t getDirtyCount() const;
+
+        /**
+         * @brief Mark a light to be casted again.
+         * @param light
+         */
+        void markDirty(const LightSource* light);
+
+        /**
+         * @brief Mark to be casted again all the lights whose bounds intersect
+         * an area.
+         * @details It is meant to be called when the edges inside @p area
+         * change, so only the lights that can be affected are casted again.
+         * @param area Area of the world, in global coordinates.
+         */
+        void markDirty(const sf::FloatRect& area);
+
+        /**
+         * @brief Mark all the lights to be casted again.
+         */
+        void markAllDirty();
+
+        /**
+         * @brief Check if a light is waiting to be casted.
+         * @param light
+         * @returns True if the light is in the scheduler and dirty.
+         */
+        bool isDirty(const LightSource* light) const;
+
+        /**
+         * @brief Set the maximum time to spend casting in every @ref update.
+         * @details A zero time disables the time budget.
+         * @param budget
+         * @see setRayBudget
+         */
+        void setTimeBudget(sf::Time budget);
+
+        /**
+         * @brief Get the maximum time to spend casting in every @ref update.
+         * @see setTimeBudget
+         */
+        sf::Time getTimeBudget() const;
+
+        /**
+         * @brief Set the maximum number of rays to cast in every
+         * @ref update.
+         * @details The number of rays of a light is estimated with the
+         * vertices of its last polygon. Zero disables the ray budget, which
+         * is the default.
+         * @param budget
+         * @see setTimeBudget
+         */
+        void setRayBudget(unsigned long budget);
+
+        /**
+         * @brief Get the maximum number of rays to cast in every @ref update.
+         * @see setRayBudget
+         */
+        unsigned long getRayBudget() const;
+
+        /**
+         * @brief Set how much the waiting frames increase the priority of a
+         * light.
+         * @details A light waiting n frames has its priority multiplied by
+         * (1 + n * weight). The default weight is 0.5.
+         * @param weight
+         */
+        void setStaleWeight(float weight);
+
+        /**
+         * @brief Cast the dirty lights, the most important first, until the
+         * budget is spent.
+         * @details At least one light is casted in every call, even if it
+         * exceeds the budget, so every visible light is eventually updated.
+         * @param begin Iterator to the first edge to cast the lights with.
+         * @param end Iterator past the last edge to cast the lights with.
+         * @param view View used to find the visible lights and their
+         * priority.
+         * @returns Number of lights casted.
+         */
+        unsigned int update(const EdgeVector::iterator& begin, const EdgeVector::iterator& end, const sf::View& view);
+
+        /**
+         * @brief Cast the dirty lights with the edges of a
+         * @ref DynamicEdgeGrid, the most important first, until the budget is
+         * spent.
+         * @details Every light only takes the edges near its bounds, with
+         * @ref LightSource::castLight(const DynamicEdgeGrid&). Attach the
+         * scheduler to the grid with @ref DynamicEdgeGrid::setScheduler so
+         * the changes of the edges mark the affected lights dirty.
+         * @param edges Grid of edges to cast the lights with.
+         * @param view View used to find the visible lights and their
+         * priority.
+         * @returns Number of lights casted.
+         * @see update(const EdgeVector::iterator&, const EdgeVector::iterator&, const sf::View&)
+         */
+        unsigned int update(const DynamicEdgeGrid& edges, const sf::View& view);
+    };
+}
+
+#endif
@@ -8,11 +8,18 @@
 #ifndef __CANDLE_LIGHTSOURCE_HPP__
 #define __CANDLE_LIGHTSOURCE_HPP__
 
+#include <future>
+#include <iterator>
+#include <memory>
+#include <optional>
 #include <vector>
 
 #include "SFML/Graphics.hpp"
 
+#include "Candle/CompactEdgeVector.hpp"
+#include "Candle/geometry/Circle.hpp"
 #include "Candle/geometry/Line.hpp"
+#include "Candle/Statistics.hpp"
 
 namespace candle{
     /**
@@ -27,16 +34,125 @@ namespace candle{
      */
     typedef std::vector<Edge> EdgeVector;
     
+    /**
+     * @typedef CircleVector
+     * @brief Typedef to shorten the use of vectors as pools of round
+     * occluders.
+     */
+    typedef std::vector<sfu::Circle> CircleVector;
+    
+    class EdgeDatabase;
+    class EdgeGrid;
+    class DynamicEdgeGrid;
+    
     /**
      * @brief This function initializes the Texture used for the RadialLights.
-     * @details This function is called the first time a RadialLight is created
-     * , so the user shouldn't need to do it. Anyways, it could be 
-     * necessary to do it explicitly if you declare a RadialLight that, for 
-     * some reason, is global or static RadialLight and is not constructed in
-     * a normal order.
+     * @details This function is called the first time a RadialLight is drawn
+     * , so the user shouldn't need to do it. Constructing and casting lights
+     * doesn't require a graphics context, so they can be used headless (e.g.
+     * in benchmarks or servers). Anyways, it could be necessary to do it
+     * explicitly if you want to avoid the cost of creating the textures in
+     * the middle of the first frame.
      */
     void initializeTextures();
     
+    /**
+     * @brief Read-only view of the polygon of a light in global
+     * coordinates.
+     * @details The vertices are transformed when they are accessed, so
+     * getting the view doesn't copy the polygon. The view refers to the
+     * polygon of the light, so it is only valid until the light is casted
+     * again or destroyed.
+     * 
+     * The primitive type is the one of the polygon of the light (see
+     * @ref LightSource::getPolygon). Note that the rays of a
+     * @ref RadialLight that don't hit any edge go beyond its range: the area
+     * it lights is the polygon clipped to the circle of the range.
+     * @see LightSource::getGlobalPolygon
+     */
+    class PolygonView{
+    private:
+        const sf::VertexArray* m_polygon;
+        sf::Transform m_transform;
+        
+    public:
+        /**
+         * @brief Input iterator over the transformed vertices.
+         * @details The vertices are transformed on access and returned by
+         * value, so the iterator can't give references to them, which a
+         * forward iterator must.
+         */
+        class const_iterator{
+        private:
+            const PolygonView* m_view;
+            size_t m_index;
+            
+        public:
+            typedef std::input_iterator_tag iterator_category;
+            typedef sf::Vector2f value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const sf::Vector2f* pointer;
+            typedef sf::Vector2f reference;
+            
+            const_iterator(const PolygonView* view, size_t index);
+            
+            sf::Vector2f operator*() const;
+            const_iterator& operator++();
+            const_iterator operator++(int);
+            bool operator==(const const_iterator& other) const;
+            bool operator!=(const const_iterator& other) const;
+        };
+        
+        /**
+         * @brief Constructor.
+         * @param polygon Vertices of the polygon.
+         * @param transform Transform of the vertices to global coordinates.
+         */
+        PolygonView(const sf::VertexArray& polygon, const sf::Transform& transform);
+        
+        /**
+         * @brief Get the number of vertices.
+         */
+        size_t size() const;
+        
+        /**
+         * @brief Get a vertex in global coordinates.
+         * @param index Index of the vertex.
+         */
+        sf::Vector2f operator[](size_t index) const;
+        
+        /**
+         * @brief Get the primitive type of the polygon.
+         */
+        sf::PrimitiveType getPrimitiveType() const;
+        
+        /**
+         * @brief Get the vertices, in the local coordinates of the polygon.
+         */
+        const sf::VertexArray& getVertices() const;
+        
+        /**
+         * @brief Get the transform of the vertices to global coordinates.
+         */
+        const sf::Transform& getTransform() const;
+        
+        /**
+         * @brief Get the bounding rectangle of the polygon, in global
+         * coordinates.
+         */
+        sf::FloatRect getBounds() const;
+        
+        /**
+         * @brief Get an iterator to the first vertex.
+         */
+        const_iterator begin() const;
+        
+        /**
+         * @brief Get an iterator past the last vertex.
+         */
+        const_iterator end() const;
+    };
+    
     /**
      * @brief Interface for objects that emit light
      * @details
@@ -51,18 +167,105 @@ namespace candle{
      * the RGB value) and intensity (interpreted as the alpha value) 
      * separately.
      * 
+     * The color and the intensity are not stored in the polygon: they are
+     * applied when the light is drawn, with a shader uniform, so changing
+     * them (or animating them, see @ref setAnimation) doesn't cost more than
+     * changing a number. If shaders are not available, or the states used to
+     * draw the light already have a shader, the light keeps a colored copy
+     * of the polygon that is updated when drawn after a change. A shader of
+     * the caller can apply the tint itself instead, see
+     * @ref setShaderTint.
+     * 
      * By default, they use a sf::BlendAdd mode. This means that you can
      * specify any other blend mode you want, except sf::BlendAlpha, that
      * will be changed to the additive mode.
      */
     class LightSource: public sf::Transformable, public sf::Drawable{
+    public:
+        /**
+         * @brief Curves to animate the intensity of a light.
+         * @see setAnimation
+         */
+        enum Animation {
+            STEADY,   ///< No animation.
+            FLICKER,  ///< Random smooth variations, like a torch.
+            PULSE,    ///< Periodic sinusoidal variation.
+            FADE_IN,  ///< From zero to the intensity along a period, once.
+            FADE_OUT  ///< From the intensity to zero along a period, once.
+        };
+        
+        /**
+         * @brief Where the geometry of a light is kept to be drawn.
+         * @see setGeometryStorage
+         */
+        enum GeometryStorage {
+            /**
+             * A sf::VertexArray, sent to the GPU every time it is drawn.
+             */
+            VERTEX_ARRAY,
+            /**
+             * A sf::VertexBuffer with static usage, for lights that are
+             * casted rarely.
+             */
+            STATIC_BUFFER,
+            /**
+             * A sf::VertexBuffer with dynamic usage, for lights that are
+             * casted often but drawn more times than casted.
+             */
+            DYNAMIC_BUFFER
+        };
+        
     private:
         /**
          * @brief Draw the object to a target
          */
         virtual void draw(sf::RenderTarget& t, sf::RenderStates st) const = 0;
+        
+        // The pending asynchronous cast is not copied with the light, and a
+        // light that is destroyed waits for it, because it reads the edges
+        struct AsyncCast{
+            std::future<std::unique_ptr<LightSource>> result;
+            AsyncCast() = default;
+            AsyncCast(const AsyncCast&) {}
+            AsyncCast& operator=(const AsyncCast&) { return *this; }
+            ~AsyncCast(){
+                if(result.valid()){
+                    result.wait();
+                }
+            }
+        };
+        AsyncCast m_async;
+        
+        sf::Clock m_animationClock;
+        Animation m_animation;
+        float m_animationPeriod;
+        float m_animationAmplitude;
+        unsigned int m_animationSeed;
+        GeometryStorage m_storage;
+        bool m_static;
+        bool m_shaderTint;
   
     protected:
+        // Copy of some geometry with the color applied to the vertices, for
+        // targets without shaders, and the buffer the geometry is uploaded
+        // to, with the version and tint of its vertices. Copies of a light
+        // (like the ones casted asynchronously) start with an empty cache,
+        // so the vertices and the GPU buffer are not copied with them
+        struct GeometryCache{
+            sf::VertexArray vertices;
+            sf::Color tint;
+            unsigned long version = 0;
+            sf::VertexBuffer buffer;
+            sf::Color bufferTint;
+            unsigned long bufferVersion = 0;
+            GeometryCache() = default;
+            GeometryCache(const GeometryCache&) {}
+            GeometryCache& operator=(const GeometryCache&){
+                version = bufferVersion = 0;
+                return *this;
+            }
+        };
+        
         sf::Color m_color;
         sf::VertexArray m_polygon;
         float m_range;
@@ -72,8 +275,51 @@ namespace candle{
 #ifdef CANDLE_DEBUG        
         sf::VertexArray m_debug;
 #endif
+#ifdef CANDLE_STATISTICS
+        CastStatistics m_stats;
+#endif
+        // Transform of the state the front polygon was casted with, if it
+        // comes from castLightAsync
+        std::optional<sf::Transform> m_castTransform;
+        // Incremented every time the geometry changes
+        unsigned long m_geometryVersion;
+        mutable GeometryCache m_polygonCache;
         
+        /**
+         * @brief Update the colors of the vertices that don't depend on the
+         * color of the light, like the ones that fade.
+         */
         virtual void resetColor() = 0;
+        
+        /**
+         * @brief Draw some geometry of the light with its tint.
+         * @details It uses the tint shader if it is available and @p st has
+         * no shader, or draws the vertices untinted if the shader of @p st
+         * applies the tint (see @ref setShaderTint). Otherwise, the vertices
+         * are colored in @p cache, only if the tint or the geometry changed
+         * since the last time. With a buffer storage, the
+         * vertices are uploaded to the buffer of @p cache only when they
+         * changed.
+         */
+        void drawGeometry(sf::RenderTarget& t, sf::RenderStates st, const sf::VertexArray& geometry, GeometryCache& cache) const;
+        
+        /**
+         * @brief Get a copy of the light, to cast it in another thread.
+         */
+        virtual std::unique_ptr<LightSource> clone() const = 0;
+        
+        /**
+         * @brief Get the transform from the coordinates of the polygon to
+         * global coordinates, for the current state of the light.
+         */
+        virtual sf::Transform getPolygonTransform() const;
+        
+        /**
+         * @brief Exchange the geometry casted by two lights of the same type.
+         * @details It is used by @ref swapBuffers. Lights with geometry
+         * besides the polygon should override it to exchange it too.
+         */
+        virtual void swapGeometry(LightSource& other);
     
     public:
         /**
@@ -121,6 +367,128 @@ namespace candle{
          */
         sf::Color getColor() const;
         
+        /**
+         * @brief Set the curve to animate the intensity of the light.
+         * @details The intensity the light is drawn with is the one set with
+         * @ref setIntensity multiplied by a factor that changes over time:
+         *   - FLICKER: it takes a new random value between 1 - @p amplitude
+         * and 1 every @p period seconds, interpolated smoothly.
+         *   - PULSE: it goes from 1 to 1 - @p amplitude and back every
+         * @p period seconds.
+         *   - FADE_IN, FADE_OUT: it goes from 0 to 1 (or from 1 to 0) in
+         * @p period seconds, and then it stays.
+         * 
+         * The animation is evaluated when the light is drawn, so it doesn't
+         * need to modify the polygon. It starts in this call.
+         * 
+         * This holds as long as shaders are available and the light is
+         * drawn without a shader of the caller, or with one that applies the
+         * tint (see @ref setShaderTint). Otherwise, the tint is applied to a
+         * copy of the vertices, so an animated light
+         * copies and recolors its whole geometry every frame the intensity
+         * changes, and with a buffer storage (see @ref setGeometryStorage)
+         * it uploads it again too.
+         * @param animation Curve to use.
+         * @param period Duration of the cycle of the curve, in seconds.
+         * @param amplitude Maximum reduction of the intensity, from 0 to 1.
+         * @see getAnimation, restartAnimation
+         */
+        void setAnimation(Animation animation, float period = 1.f, float amplitude = 0.5f);
+        
+        /**
+         * @brief Get the curve of the animation of the light.
+         * @see setAnimation
+         */
+        Animation getAnimation() const;
+        
+        /**
+         * @brief Start the animation again from the beginning.
+         * @see setAnimation
+         */
+        void restartAnimation();
+        
+        /**
+         * @brief Get the intensity the light would be drawn with now.
+         * @returns The intensity multiplied by the animation.
+         * @see setIntensity, setAnimation
+         */
+        float getAnimatedIntensity() const;
+        
+        /**
+         * @brief Get the color to draw the light with.
+         * @details It is the color of the light with the intensity as alpha,
+         * multiplied by the current value of the animation.
+         * @see setShaderTint
+         */
+        sf::Color getTint() const;
+        
+        /**
+         * @brief Set where the geometry of the light is kept to be drawn.
+         * @details With a VERTEX_ARRAY, the vertices are sent to the GPU every
+         * time the light is drawn. With a buffer, they are uploaded the first
+         * time the light is drawn after a call to @ref castLight, so lights
+         * that are not casted every frame don't use the bus to be drawn.
+         * 
+         * If vertex buffers are not available, the VERTEX_ARRAY storage is
+         * used anyways.
+         * 
+         * The default value is VERTEX_ARRAY.
+         * @param storage Storage of the geometry.
+         * @see getGeometryStorage
+         */
+        void setGeometryStorage(GeometryStorage storage);
+        
+        /**
+         * @brief Get where the geometry of the light is kept to be drawn.
+         * @see setGeometryStorage
+         */
+        GeometryStorage getGeometryStorage() const;
+        
+        /**
+         * @brief Mark the light as static.
+         * @details Static lights are meant to never move nor change over
+         * static edges, so they can be casted once and baked in the
+         * lightmap of a @ref LightingArea (see @ref LightingArea::bake).
+         * Areas with a lightmap ignore the static lights drawn on them.
+         * 
+         * The default value is false.
+         * @param isStatic Value to set the flag.
+         * @see isStatic
+         */
+        void setStatic(bool isStatic);
+        
+        /**
+         * @brief Check if the light is static.
+         * @returns The value of the _static_ flag.
+         * @see setStatic
+         */
+        bool isStatic() const;
+        
+        /**
+         * @brief Set if the shader of the states the light is drawn with
+         * applies its tint.
+         * @details By default, a light drawn with a shader in its states
+         * keeps a colored copy of its polygon, like without shaders, which
+         * is copied again every time the tint changes. If this flag is set,
+         * the polygon is drawn untinted with that shader instead, and the
+         * shader must multiply its output by the tint, that the caller
+         * passes to it from @ref getTint before drawing the light. The
+         * shader is not modified by the light.
+         * 
+         * The flag is ignored if the states have no shader. The default
+         * value is false.
+         * @param shaderTint Value to set the flag.
+         * @see getShaderTint
+         */
+        void setShaderTint(bool shaderTint);
+        
+        /**
+         * @brief Check if the shader of the states the light is drawn with
+         * applies its tint.
+         * @see setShaderTint
+         */
+        bool getShaderTint() const;
+        
         /**
          * @brief Set the value of the _fade_ flag.
          * @details when the @p fade flag is set, the light will lose intensity
@@ -157,6 +525,73 @@ namespace candle{
          */
         float getRange() const;
         
+        /**
+         * @brief Get the number of vertices of the polygon of the light.
+         * @details It grows with the number of rays casted in the last call
+         * to @ref castLight, so it can be used to estimate its cost.
+         * @returns The number of vertices of the polygon.
+         */
+        size_t getVertexCount() const;
+        
+        /**
+         * @brief Get the polygon of the illuminated area.
+         * @details The vertices are in the local coordinates of the polygon,
+         * given by @ref getDrawTransform. Its primitive type depends on the
+         * type of light: a triangle fan from the center for
+         * @ref RadialLight and a triangle strip for @ref DirectedLight.
+         * @returns The polygon of the last cast.
+         */
+        const sf::VertexArray& getPolygon() const;
+        
+        /**
+         * @brief Get the transform to draw the polygon with.
+         * @details It is the transform from the coordinates of the polygon to
+         * global coordinates, for the state of the light when the polygon
+         * was casted.
+         * @see getPolygon
+         */
+        sf::Transform getDrawTransform() const;
+        
+        /**
+         * @brief Get the polygon of the illuminated area in global
+         * coordinates.
+         * @details The polygon is not copied; its vertices are transformed
+         * as they are read from the view.
+         * @returns A view of the polygon of the last cast.
+         * @see PolygonView, getPolygon
+         */
+        PolygonView getGlobalPolygon() const;
+        
+        /**
+         * @brief Get the local bounding rectangle of the light.
+         * @returns The local bounding rectangle in float.
+         */
+        virtual sf::FloatRect getLocalBounds() const = 0;
+        
+        /**
+         * @brief Get the global bounding rectangle of the light.
+         * @returns The global bounding rectangle in float.
+         */
+        virtual sf::FloatRect getGlobalBounds() const = 0;
+        
+        /**
+         * @brief Check if the light may be seen through a view.
+         * @details A light is visible if its global bounds intersect the area
+         * of the world shown by the @p view. Lights that are not visible
+         * don't need to call @ref castLight, and they are not submitted when
+         * drawn to a target whose view doesn't show them.
+         * 
+         * Note that the polygon of a light that skips @ref castLight is
+         * not updated, so it should be casted again when it becomes visible
+         * if it moved or the edges changed meanwhile.
+         * @param view View to check.
+         * @param transform Optional transformation applied to the light
+         * before the view.
+         * @returns True if the light intersects the view.
+         * @see getGlobalBounds
+         */
+        bool isVisible(const sf::View& view, const sf::Transform& transform = sf::Transform::Identity) const;
+        
         /**
          * @brief Modify the polygon of the illuminated area with a 
          * raycasting algorithm.
@@ -170,6 +605,136 @@ namespace candle{
          * @see setRange, [EdgeVector](@ref LightSource.hpp)
          */
         virtual void castLight(const EdgeVector::iterator& begin, const EdgeVector::iterator& end) = 0;
+        
+        /**
+         * @brief Modify the polygon of the illuminated area with edges and
+         * round occluders.
+         * @details Round obstacles, like pillars or characters, cast shadows
+         * as circles instead of polygonizing them into many edges. By
+         * default, the circles are approximated with 16 edges each, but
+         * lights may intersect them analytically.
+         * @param begin Iterator to the first sfu::Line of the vector to take 
+         * into account.
+         * @param end Iterator to the first sfu::Line of the vector not to be
+         * taken into account.
+         * @param circlesBegin Iterator to the first sfu::Circle to take into
+         * account.
+         * @param circlesEnd Iterator to the first sfu::Circle not to be
+         * taken into account.
+         * @see castLight, [CircleVector](@ref LightSource.hpp)
+         */
+        virtual void castLight(const EdgeVector::iterator& begin, const EdgeVector::iterator& end,
+                               const CircleVector::const_iterator& circlesBegin,
+                               const CircleVector::const_iterator& circlesEnd);
+        
+        /**
+         * @brief Modify the polygon of the illuminated area with quantized
+         * edges.
+         * @details The lights of Candle read the edges straight from the
+         * iterators, decoding them on the fly. By default, the range is
+         * decoded into an @ref EdgeVector first.
+         * @param begin Iterator to the first edge to take into account.
+         * @param end Iterator to the first edge not to be taken into
+         * account.
+         * @see castLight, CompactEdgeVector::begin(const sf::FloatRect&) const
+         */
+        virtual void castLight(const CompactEdgeVector::const_iterator& begin,
+                               const CompactEdgeVector::const_iterator& end);
+        
+        /**
+         * @brief Modify the polygon of the illuminated area with the edges
+         * of a @ref CompactEdgeVector.
+         * @details Only the chunks that intersect the bounds of the light
+         * are read, and they are not copied.
+         * @param edges Quantized edges.
+         * @see castLight, CompactEdgeVector
+         */
+        void castLight(const CompactEdgeVector& edges);
+        
+        /**
+         * @brief Modify the polygon of the illuminated area with the edges
+         * of an @ref EdgeDatabase.
+         * @details Only the chunks that intersect the bounds of the light
+         * are requested to the database.
+         * @param edges Database of edges.
+         * @see castLight, EdgeDatabase
+         */
+        void castLight(EdgeDatabase& edges);
+        
+        /**
+         * @brief Modify the polygon of the illuminated area with the edges
+         * of an @ref EdgeGrid.
+         * @details Only the edges in the cells that intersect the bounds of
+         * the light are used.
+         * @param edges Grid of edges.
+         * @see castLight, EdgeGrid
+         */
+        void castLight(const EdgeGrid& edges);
+        
+        /**
+         * @brief Modify the polygon of the illuminated area with the edges
+         * of a @ref DynamicEdgeGrid.
+         * @details Only the edges near the bounds of the light are used.
+         * @param edges Grid of edges.
+         * @see castLight, DynamicEdgeGrid
+         */
+        void castLight(const DynamicEdgeGrid& edges);
+        
+        /**
+         * @brief Start casting the light in a worker thread.
+         * @details The cast is queued to the background workers of the
+         * library (see @ref runInBackground), so no thread is created. The
+         * polygon is computed from a copy of the light taken
+         * in this call, into a back buffer, while the light keeps drawing the
+         * current polygon. The new polygon replaces the current one in the
+         * next call to @ref swapBuffers, and it is drawn with the transform
+         * the light had in this call, so the shadows stay aligned with the
+         * edges even if the light moves meanwhile.
+         * 
+         * The edges in [@p begin, @p end) must not be modified until the
+         * buffers are swapped. If a cast is already pending, this function
+         * waits for it and discards its result.
+         * @param begin Iterator to the first sfu::Line of the vector to take 
+         * into account.
+         * @param end Iterator to the first sfu::Line of the vector not to be
+         * taken into account.
+         * @see swapBuffers, castLight
+         */
+        void castLightAsync(const EdgeVector::iterator& begin, const EdgeVector::iterator& end);
+        
+        /**
+         * @brief Replace the polygon with the result of the last call to
+         * @ref castLightAsync.
+         * @details The intended use is to call it at the beginning of every
+         * frame, before drawing, and to start the cast of the next frame right
+         * after. If the cast has not finished yet, this function waits for it.
+         * @returns True if there was a pending cast to swap.
+         * @see castLightAsync, isCastPending
+         */
+        bool swapBuffers();
+        
+        /**
+         * @brief Check if there is a cast started with @ref castLightAsync
+         * that has not been swapped yet.
+         * @returns True if there is a pending cast.
+         */
+        bool isCastPending() const;
+        
+        /**
+         * @brief Get the statistics of the calls to @ref castLight.
+         * @details The statistics are accumulated since the construction of
+         * the light or the last call to @ref resetCastStatistics. They are
+         * only collected if the library is compiled with CANDLE_STATISTICS.
+         * @returns The accumulated statistics of this light.
+         * @see CastStatistics, getFrameStatistics
+         */
+        const CastStatistics& getCastStatistics() const;
+        
+        /**
+         * @brief Set to zero the statistics of this light.
+         * @see getCastStatistics
+         */
+        void resetCastStatistics();
     };
 }
 
@@ -8,6 +8,8 @@
 #define __CANDLE_LIGHTING_HPP__
 
 #include <set>
+#include <string>
+#include <vector>
 
 #include "SFML/Graphics.hpp"
 
@@ -86,12 +88,19 @@ namespace candle{
         float m_opacity;
         sf::Vector2f m_size;
         Mode m_mode;
+        sf::Texture m_lightmap;
+        bool m_hasLightmap;
+        float m_blurRadius;
+        unsigned int m_blurDownsampling;
+        sf::RenderTexture m_blurTextures[2];
+        std::vector<sf::RenderTexture> m_blurChain; // halvings before the low resolution
         /**
          * @brief Draw the object to the target.
          */
         void draw(sf::RenderTarget&, sf::RenderStates)const override;
         sf::Color getActualColor() const;
         void initializeRenderTexture(const sf::Vector2f& size);
+        void blur();
     public:
         
         /**
@@ -224,14 +233,116 @@ namespace candle{
          * @brief In FOG mode, makes visible the area illuminated by the light.
          * @details In FOG mode with opacity greater than zero, this function.
          * is necessary to keep the lighting coherent. In AMBIENT mode, this
-         * function has no effect. 
+         * function has no effect. Lights whose global bounds don't intersect
+         * the area, and static lights if the area has a lightmap, are
+         * skipped.
          * @param light
          */
         void draw(const LightSource& light);
         
+        /**
+         * @brief Render the static lights in a persistent lightmap.
+         * @details The area is cleared with its color or texture, the lights
+         * marked as static (see @ref LightSource::setStatic) are drawn on it,
+         * and the result is kept as the lightmap of the area. From then on,
+         * @ref clear restores the lightmap instead of the color or texture,
+         * and @ref draw ignores the static lights, so only the dynamic ones
+         * need to be casted and drawn every frame.
+         * 
+         * In FOG mode, the lights uncover the fog as in @ref draw. In AMBIENT
+         * mode, their color is added to the area, so it can be drawn to
+         * replace drawing the static lights themselves.
+         * 
+         * The lights must have been casted before. Changes to the color,
+         * opacity or texture of the area require baking it again.
+         * @param lights Lights to bake. The ones that are not static are
+         * ignored.
+         * @see saveLightmap, loadLightmap, clearLightmap
+         */
+        void bake(const std::vector<const LightSource*>& lights);
+        
+        /**
+         * @brief Check if the area has a lightmap.
+         * @returns True if @ref bake or @ref loadLightmap were called after
+         * the last call to @ref clearLightmap.
+         */
+        bool hasLightmap() const;
+        
+        /**
+         * @brief Discard the lightmap.
+         * @details The next calls to @ref clear restore the color or the
+         * texture again.
+         */
+        void clearLightmap();
+        
+        /**
+         * @brief Save the lightmap to an image file.
+         * @details It can be used to bake the lights offline and load them
+         * with @ref loadLightmap.
+         * @param path Path of the file. The format is deduced from the
+         * extension, as in sf::Image::saveToFile.
+         * @returns True if the area has a lightmap and it could be saved.
+         */
+        bool saveLightmap(const std::string& path) const;
+        
+        /**
+         * @brief Load the lightmap from an image file.
+         * @details The image must have the same size as the area (the one of
+         * its sf::RenderTexture, before any transformation).
+         * @param path Path of the file.
+         * @returns True if the lightmap could be loaded.
+         */
+        bool loadLightmap(const std::string& path);
+        
+        /**
+         * @brief Set the radius of the blur applied by @ref display.
+         * @details A blurred area has soft edges in its lights and fog. The
+         * area is downsampled (see @ref setBlurDownsampling), blurred with a
+         * gaussian in two separable passes at the low resolution and
+         * upsampled back, so it costs a fraction of a blur at full
+         * resolution. The radius is capped to 16 pixels of the low
+         * resolution, downsampling more if needed.
+         * 
+         * The area is downsampled by halving it repeatedly, and each pixel of
+         * a half is the average of 2x2 pixels, so every pixel of the area
+         * contributes to the low resolution and thin lights don't shimmer
+         * when they move.
+         * 
+         * If shaders are not available, the area is only downsampled and
+         * upsampled, which softens it a bit less.
+         * 
+         * The default value is 0 (no blur).
+         * @param radius Radius in pixels of the area.
+         * @see getBlurRadius
+         */
+        void setBlurRadius(float radius);
+        
+        /**
+         * @brief Get the radius of the blur applied by @ref display.
+         * @see setBlurRadius
+         */
+        float getBlurRadius() const;
+        
+        /**
+         * @brief Set the factor the area is downsampled by to blur it.
+         * @details Bigger factors are faster but the blur is coarser. The
+         * factor is rounded up to a power of two. The default value is 4.
+         * @param factor
+         * @see setBlurRadius
+         */
+        void setBlurDownsampling(unsigned int factor);
+        
+        /**
+         * @brief Get the factor the area is downsampled by to blur it.
+         * @see setBlurDownsampling
+         */
+        unsigned int getBlurDownsampling() const;
+        
         /**
          * @brief Calls display on the sf::RenderTexture.
-         * @details Updates the changes made since the last call to @ref clear.
+         * @details Updates the changes made since the last call to @ref clear,
+         * and blurs the area if it has a blur radius.
+         * @see setBlurRadius
          */
         void display();
     };
@@ -0,0 +1,122 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the OccluderGenerator class.
+ */
+#ifndef __CANDLE_OCCLUDER_GENERATOR_HPP__
+#define __CANDLE_OCCLUDER_GENERATOR_HPP__
+
+#include <cstdint>
+
+#include "SFML/Graphics.hpp"
+
+#include "Candle/LightSource.hpp"
+
+namespace candle{
+    /**
+     * @brief Generates the edges of the occluders painted in the alpha
+     * channel of an image.
+     * @details
+     *
+     * The pixels whose alpha is at least the threshold are solid. Their
+     * outlines are traced with marching squares, interpolating the alpha
+     * between neighbour pixels, so antialiased masks give smooth contours.
+     * The outlines are then simplified with the Douglas-Peucker algorithm:
+     * vertices closer than the tolerance to the simplified outline are
+     * removed, so straight walls become a single edge instead of one per
+     * pixel.
+     *
+     * The image is divided in square tiles processed in parallel. The
+     * outlines are cut at the borders of the tiles, whose vertices are
+     * kept, so the edges of neighbour tiles meet exactly.
+     *
+     * The edges are generated in the coordinates of the pixels of the image,
+     * where the pixel (x, y) covers [x, x + 1) x [y, y + 1), and can be
+     * transformed to the world with the optional transform.
+     */
+    class OccluderGenerator{
+    private:
+        float m_tolerance;
+        std::uint8_t m_threshold;
+        unsigned int m_tileSize;
+        unsigned int m_threads;
+
+    public:
+        /**
+         * @brief Constructor.
+         * @details By default, the tolerance is 1 pixel, the alpha threshold
+         * is 128 and the tiles are 256 pixels wide.
+         */
+        OccluderGenerator();
+
+        /**
+         * @brief Set the maximum distance between the outline and the
+         * simplified edges.
+         * @details Zero only removes the vertices in the middle of straight
+         * lines.
+         * @param tolerance Distance in pixels.
+         */
+        void setTolerance(float tolerance);
+
+        /**
+         * @brief Get the maximum distance between the outline and the
+         * simplified edges.
+         * @see setTolerance
+         */
+        float getTolerance() const;
+
+        /**
+         * @brief Set the minimum alpha of the solid pixels.
+         * @param threshold
+         */
+        void setAlphaThreshold(std::uint8_t threshold);
+
+        /**
+         * @brief Get the minimum alpha of the solid pixels.
+         * @see setAlphaThreshold
+         */
+        std::uint8_t getAlphaThreshold() const;
+
+        /**
+         * @brief Set the side of the tiles processed in parallel.
+         * @param pixels Side of the tiles, in pixels.
+         */
+        void setTileSize(unsigned int pixels);
+
+        /**
+         * @brief Get the side of the tiles processed in parallel.
+         * @see setTileSize
+         */
+        unsigned int getTileSize() const;
+
+        /**
+         * @brief Set the number of threads.
+         * @details Zero means one per hardware thread, which is the
+         * default.
+         * @param threads
+         */
+        void setThreadCount(unsigned int threads);
+
+        /**
+         * @brief Get the number of threads.
+         * @see setThreadCount
+         */
+        unsigned int getThreadCount() const;
+
+        /**
+         * @brief Generate the edges of the solid regions of an image.
+         * @details The edges are appended to @p out, ordered by tile. They
+         * can be packed afterwards in a @ref CompactEdgeVector.
+         * @param mask Image whose alpha channel has the occluders.
+         * @param out Vector to append the edges to.
+         * @param transform Transform from the coordinates of the pixels to
+         * the world.
+         * @returns The number of edges appended.
+         */
+        size_t generate(const sf::Image& mask, EdgeVector& out,
+                        const sf::Transform& transform = sf::Transform::Identity) const;
+    };
+}
+
+#endif
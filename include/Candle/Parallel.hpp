@@ -0,0 +1,145 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the helpers used to split the work of the
+ * library across threads.
+ */
+#ifndef __CANDLE_PARALLEL_HPP__
+#define __CANDLE_PARALLEL_HPP__
+
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace candle{
+    /**
+     * @brief Get the actual number of threads to use.
+     * @param threads Requested number of threads. Zero means one per
+     * hardware thread.
+     * @returns The number of threads, at least one.
+     */
+    inline unsigned int resolveThreadCount(unsigned int threads){
+        if(threads == 0){
+            threads = std::thread::hardware_concurrency();
+        }
+        return std::max(threads, 1u);
+    }
+
+    /**
+     * @brief Run a function in the background workers of the library.
+     * @details The workers are a few threads, one per hardware thread but
+     * one and at least one, that take the functions from a queue in order.
+     * They are started the first time they are needed and live until the end
+     * of the program, so the work that is sent to the background every frame
+     * doesn't create any thread. The functions that are still queued at the
+     * end of the program are run before the workers are stopped.
+     * @param task Function to run.
+     * @see runAsync
+     */
+    void runInBackground(std::function<void()> task);
+
+    /**
+     * @brief Run a function in the background workers of the library and
+     * get its result.
+     * @details Unlike the one returned by std::async, the future doesn't wait
+     * for the function when it is destroyed.
+     * @param f Function to run, without arguments. It may be move only.
+     * @returns The future result of @p f.
+     * @see runInBackground
+     */
+    template <typename F>
+    std::future<std::invoke_result_t<F>> runAsync(F f){
+        auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::move(f));
+        std::future<std::invoke_result_t<F>> result = task->get_future();
+        runInBackground([task] { (*task)(); });
+        return result;
+    }
+
+    /**
+     * @brief Run a function for several blocks of work, in the calling
+     * thread and the background workers of the library.
+     * @details Every thread takes the next block that nobody has taken, so
+     * the calling thread never waits for a block that isn't running, and
+     * the calls made from the workers themselves (like the casts of
+     * @ref LightSource::castLightAsync) don't wait for each other. It
+     * returns when every block is done. If some blocks throw, the first
+     * exception is rethrown then.
+     * @param blocks Number of blocks.
+     * @param body Function called with the index of each block.
+     * @see parallelFor
+     */
+    void runBlocks(size_t blocks, const std::function<void(size_t)>& body);
+
+    /**
+     * @brief Split the range [0, @p count) in contiguous blocks and process
+     * them in several threads.
+     * @details The blocks are processed by @p f(begin, end, block), where
+     * block is the index of the block. Blocks are never smaller than
+     * @p minBlock, so small ranges are processed in the calling thread. The
+     * rest are processed with @ref runBlocks, so no thread is created.
+     * @param count Number of elements.
+     * @param threads Maximum number of threads (see @ref resolveThreadCount).
+     * @param minBlock Minimum number of elements per block.
+     * @param f Function to process a block.
+     * @returns Number of blocks used.
+     */
+    template <typename F>
+    unsigned int parallelFor(size_t count, unsigned int threads, size_t minBlock, F f){
+        size_t blocks = std::min<size_t>(resolveThreadCount(threads), count / std::max<size_t>(minBlock, 1));
+        if(blocks <= 1){
+            f(size_t(0), count, 0u);
+            return 1;
+        }
+        runBlocks(blocks, [&] (size_t b){
+            f(count * b / blocks, count * (b + 1) / blocks, unsigned(b));
+        });
+        return blocks;
+    }
+
+    /**
+     * @brief Sort a range with several threads.
+     * @details The range is split in blocks that are sorted in parallel and
+     * then merged. With a strict total order the result is the same as the
+     * one of std::sort.
+     * @param begin Random access iterator to the first element.
+     * @param end Random access iterator past the last element.
+     * @param threads Maximum number of threads (see @ref resolveThreadCount).
+     * @param minBlock Minimum number of elements per block.
+     * @param comp Comparison function.
+     */
+    template <typename It, typename Compare>
+    void parallelSort(It begin, It end, unsigned int threads, size_t minBlock, Compare comp){
+        size_t count = end - begin;
+        std::vector<size_t> bounds;
+        unsigned int blocks = parallelFor(count, threads, minBlock,
+            [&] (size_t b, size_t e, unsigned int){
+                std::sort(begin + b, begin + e, comp);
+            }
+        );
+        for(unsigned int b = 0; b <= blocks; b++){
+            bounds.push_back(count * b / blocks);
+        }
+        // merge pairs of neighbour blocks until there is only one
+        while(bounds.size() > 2){
+            size_t merges = (bounds.size() - 1) / 2;
+            runBlocks(merges, [&] (size_t m){
+                std::inplace_merge(begin + bounds[2*m], begin + bounds[2*m + 1], begin + bounds[2*m + 2], comp);
+            });
+            std::vector<size_t> merged;
+            for(size_t i = 0; i < bounds.size(); i += 2){
+                merged.push_back(bounds[i]);
+            }
+            if(merged.back() != bounds.back()){
+                merged.push_back(bounds.back());
+            }
+            bounds.swap(merged);
+        }
+    }
+}
+
+#endif
@@ -30,12 +30,59 @@ namespace candle{
      * </table>
      */
     class RadialLight: public LightSource{
+    public:
+        /**
+         * @brief Levels of detail of the shadows of a RadialLight.
+         * @details Lower levels are cheaper to cast, so they are meant for
+         * lights that are small on screen or far from the camera.
+         * @see setDetailLevel, updateDetailLevel
+         */
+        enum DetailLevel {
+            /**
+             * All the edges in range are taken into account, with three rays
+             * to each endpoint.
+             */
+            FULL,
+            /**
+             * Edges shorter than 1/32 of the range are ignored, only one ray
+             * is casted to each endpoint and the polygon has 256 rays at most.
+             */
+            REDUCED,
+            /**
+             * Edges shorter than 1/8 of the range are ignored, only one ray
+             * is casted to each endpoint and the polygon has 64 rays at most.
+             */
+            MINIMAL,
+            /**
+             * No shadows are casted, only the light itself is drawn.
+             */
+            UNSHADOWED
+        };
     private:
         static int s_instanceCount;
         float m_beamAngle;
+        DetailLevel m_detail;
+        float m_detailThresholds[3];
+        unsigned int m_threads;
+        float m_sourceRadius;
+        float m_mergeTolerance;
+        sf::VertexArray m_penumbra;
+        mutable GeometryCache m_penumbraCache;
 
         void draw(sf::RenderTarget& t, sf::RenderStates st) const override;
         void resetColor() override;
+        std::unique_ptr<LightSource> clone() const override;
+        sf::Transform getPolygonTransform() const override;
+        void swapGeometry(LightSource& other) override;
+        void castPenumbrae(const std::vector<sf::Vector2f>& points, bool closed);
+        template <typename Iterator>
+        void castBeam(const Iterator& begin, const Iterator& end,
+                      const CircleVector::const_iterator& circlesBegin,
+                      const CircleVector::const_iterator& circlesEnd);
+        template <typename Beam, typename Iterator>
+        void cast(const Iterator& begin, const Iterator& end,
+                  const CircleVector::const_iterator& circlesBegin,
+                  const CircleVector::const_iterator& circlesEnd);
 
     public:
         /**
@@ -43,6 +90,11 @@ namespace candle{
          */
         RadialLight();
 
+        /**
+         * @brief Copy constructor
+         */
+        RadialLight(const RadialLight& other);
+
         /**
          * @brief Destructor
          */
@@ -50,6 +102,24 @@ namespace candle{
 
         void castLight(const EdgeVector::iterator& begin, const EdgeVector::iterator& end) override;
 
+        /**
+         * @brief Modify the polygon of the illuminated area with edges and
+         * round occluders.
+         * @details Every circle casts exactly two rays, towards the points
+         * where the tangents from the light touch it (and, in the FULL level
+         * of detail, two more just past them), and the rays are intersected
+         * with the circles analytically. The front of a circle is
+         * approximated by the chord between its tangent points. Circles that
+         * contain the light are ignored.
+         * @see LightSource::castLight
+         */
+        void castLight(const EdgeVector::iterator& begin, const EdgeVector::iterator& end,
+                       const CircleVector::const_iterator& circlesBegin,
+                       const CircleVector::const_iterator& circlesEnd) override;
+        void castLight(const CompactEdgeVector::const_iterator& begin,
+                       const CompactEdgeVector::const_iterator& end) override;
+        using LightSource::castLight;
+
         /**
          * @brief Set the range for which rays may be casted.
          * @details The angle shall be specified in degrees. The angle in which the rays will be casted will be
@@ -70,13 +140,138 @@ namespace candle{
          * @brief Get the local bounding rectangle of the light.
          * @returns The local bounding rectangle in float.
          */
-        sf::FloatRect getLocalBounds() const;
+        sf::FloatRect getLocalBounds() const override;
 
         /**
          * @brief Get the global bounding rectangle of the light.
          * @returns The global bounding rectangle in float.
          */
-        sf::FloatRect getGlobalBounds() const;
+        sf::FloatRect getGlobalBounds() const override;
+
+        /**
+         * @brief Set the number of threads used by @ref castLight.
+         * @details The filtering of the edges, the generation and sorting of
+         * the rays and the casting of the rays are split across the
+         * threads. It is only worth it for lights that see many edges, and
+         * small casts are done in the calling thread anyway. The resulting
+         * polygon is the same with any number of threads.
+         *
+         * The default value is 1. Zero means one thread per hardware thread.
+         * @param threads
+         * @see getThreadCount
+         */
+        void setThreadCount(unsigned int threads);
+
+        /**
+         * @brief Get the number of threads used by @ref castLight.
+         * @see setThreadCount
+         */
+        unsigned int getThreadCount() const;
+
+        /**
+         * @brief Set the radius of the body that emits the light.
+         * @details A light with a radius greater than zero casts soft shadows:
+         * at every endpoint of an edge where a shadow starts, @ref castLight
+         * adds a penumbra wedge, a triangle that fades from the light into
+         * the shadow, as wide as the angle the source subtends from the
+         * endpoint. They are drawn along with the polygon, so a soft shadow
+         * costs about the same as a hard one.
+         *
+         * Penumbrae are only casted with the FULL level of detail. The
+         * default radius is 0 (hard shadows).
+         * @param radius Radius of the source, in world units.
+         * @see getSourceRadius
+         */
+        void setSourceRadius(float radius);
+
+        /**
+         * @brief Get the radius of the body that emits the light.
+         * @see setSourceRadius
+         */
+        float getSourceRadius() const;
+
+        /**
+         * @brief Set the distance under which the vertices of the polygon are
+         * merged.
+         * @details After casting the rays, @ref castLight removes the
+         * vertices whose ray crosses the segment between their neighbours
+         * closer than the tolerance, like the ones of consecutive hits along
+         * the same wall. The distance is measured along the rays, so no ray
+         * of the polygon moves more than the tolerance, even next to the
+         * segments almost aligned with them. The polygon has fewer vertices
+         * to upload and rasterize. The number of vertices removed is
+         * reported in the [statistics](@ref CastStatistics) of the cast.
+         *
+         * The default value is 0, which keeps every vertex.
+         * @param tolerance Distance in world units.
+         * @see getMergeTolerance
+         */
+        void setMergeTolerance(float tolerance);
+
+        /**
+         * @brief Get the distance under which the vertices of the polygon are
+         * merged.
+         * @see setMergeTolerance
+         */
+        float getMergeTolerance() const;
+
+        /**
+         * @brief Set the level of detail of the shadows.
+         * @details It takes effect on the next call to @ref castLight.
+         *
+         * The default value is FULL.
+         * @param level
+         * @see getDetailLevel, updateDetailLevel
+         */
+        void setDetailLevel(DetailLevel level);
+
+        /**
+         * @brief Get the level of detail of the shadows.
+         * @returns The level of detail.
+         * @see setDetailLevel
+         */
+        DetailLevel getDetailLevel() const;
+
+        /**
+         * @brief Set the on-screen radius of the light under which each
+         * level of detail is used by @ref updateDetailLevel.
+         * @details The radii are in pixels. The defaults are 128, 32 and 8.
+         * @param reduced Radius under which the level is REDUCED.
+         * @param minimal Radius under which the level is MINIMAL.
+         * @param unshadowed Radius under which the level is UNSHADOWED.
+         */
+        void setDetailThresholds(float reduced, float minimal, float unshadowed);
+
+        /**
+         * @brief Choose the level of detail from the on-screen radius of the
+         * light.
+         * @param screenRadius Radius of the light, in pixels.
+         * @returns The new level of detail.
+         * @see setDetailThresholds
+         */
+        DetailLevel updateDetailLevel(float screenRadius);
+
+        /**
+         * @brief Choose the level of detail from the size the light has when
+         * drawn with a view.
+         * @param view View used to draw the light.
+         * @param targetSize Size in pixels of the target the light is drawn to.
+         * @returns The new level of detail.
+         * @see setDetailThresholds
+         */
+        DetailLevel updateDetailLevel(const sf::View& view, const sf::Vector2u& targetSize);
+
+        /**
+         * @brief Choose the level of detail from the distance to a camera.
+         * @details The on-screen radius is estimated as
+         * range * focalLength / distance.
+         * @param camera Position of the camera.
+         * @param focalLength Pixels that one unit of space measures at a
+         * distance of one unit from the camera.
+         * @returns The new level of detail.
+         * @see setDetailThresholds
+         */
+        DetailLevel updateDetailLevel(const sf::Vector2f& camera, float focalLength);
 
     };
 }
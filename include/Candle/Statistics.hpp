@@ -0,0 +1,70 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the CastStatistics struct and the functions to
+ * query the statistics of the current frame.
+ */
+#ifndef __CANDLE_STATISTICS_HPP__
+#define __CANDLE_STATISTICS_HPP__
+
+#include "SFML/System/Time.hpp"
+
+namespace candle{
+    /**
+     * @brief Counters of the work done by @ref LightSource::castLight.
+     * @details The counters are only updated if the library is compiled with
+     * the macro CANDLE_STATISTICS defined (option CANDLE_STATISTICS in
+     * CMake). Otherwise, all the code that updates them is compiled out and
+     * they are always zero.
+     *
+     * They can be queried per light, with
+     * @ref LightSource::getCastStatistics, or for all the lights at once, with
+     * @ref getFrameStatistics.
+     */
+    struct CastStatistics{
+        unsigned long casts = 0; ///< Calls to castLight.
+        unsigned long edgesConsidered = 0; ///< Edges (and circles) passed to castLight.
+        unsigned long edgesCulled = 0; ///< Edges discarded because they are out of the circle or cone of the light or too small for its level of detail.
+        unsigned long raysGenerated = 0; ///< Rays casted.
+        unsigned long intersectionTests = 0; ///< Ray-edge and ray-circle intersection tests.
+        unsigned long polygonVertices = 0; ///< Vertices of the resulting polygons.
+        unsigned long verticesMerged = 0; ///< Vertices removed from the polygons by RadialLight::setMergeTolerance.
+        sf::Time castTime; ///< Time spent inside castLight.
+
+        /**
+         * @brief Accumulate the counters of @p other into these.
+         */
+        CastStatistics& operator+=(const CastStatistics& other);
+
+        /**
+         * @brief Set all the counters to zero.
+         */
+        void reset();
+    };
+
+    /**
+     * @brief Get the statistics accumulated by all the lights since the last
+     * call to @ref resetFrameStatistics.
+     * @details It is safe to call this function while lights are being casted
+     * in other threads.
+     * @returns The accumulated statistics.
+     */
+    CastStatistics getFrameStatistics();
+
+    /**
+     * @brief Set to zero the statistics returned by @ref getFrameStatistics.
+     * @details The intended use is to call it at the beginning of every frame
+     * and to query the statistics at the end of it.
+     */
+    void resetFrameStatistics();
+
+    /**
+     * @brief Add the statistics of a cast to the ones of the frame.
+     * @details This function is called by the lights themselves, so the user
+     * shouldn't need to do it.
+     */
+    void addFrameStatistics(const CastStatistics& stats);
+}
+
+#endif
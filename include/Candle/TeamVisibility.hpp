@@ -0,0 +1,140 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the TeamVisibility class.
+ */
+#ifndef __CANDLE_TEAM_VISIBILITY_HPP__
+#define __CANDLE_TEAM_VISIBILITY_HPP__
+
+#include <vector>
+
+#include "SFML/Graphics.hpp"
+
+#include "Candle/BitGrid.hpp"
+#include "Candle/LightSource.hpp"
+
+namespace candle{
+    /**
+     * @brief Fog of war of several teams, computed without rendering.
+     * @details
+     *
+     * Every unit of a team is a light (usually a @ref RadialLight with the
+     * beam of its sight) casted as usual with @ref LightSource::castLight.
+     * Every call to @ref update rasterizes the polygons of all the units in
+     * a @ref BitGrid per team, which holds the cells seen by the team, so
+     * nothing is drawn and no graphics context is needed.
+     *
+     * The rows of the grids are split among threads: every thread fills its
+     * rows with all the units that reach them, so the units of a team are
+     * merged in parallel without locks nor intermediate grids.
+     *
+     * The grids of the previous update are kept, so the cells a team has
+     * just revealed can be queried with @ref getNewlyRevealed.
+     *
+     * The visibility doesn't own the units; they must outlive it or be
+     * removed before being destroyed.
+     */
+    class TeamVisibility{
+    private:
+        struct Unit{
+            unsigned int team;
+            const LightSource* light;
+        };
+        std::vector<Unit> m_units;
+        std::vector<BitGrid> m_visible;
+        std::vector<BitGrid> m_previous;
+        unsigned int m_threads;
+
+    public:
+        /**
+         * @brief Constructor.
+         * @param area Area of the world covered by the fog.
+         * @param cellSize Side of the cells of the fog, in world units.
+         * @param teams Number of teams.
+         */
+        TeamVisibility(const sf::FloatRect& area, float cellSize, unsigned int teams);
+
+        /**
+         * @brief Get the number of teams.
+         */
+        unsigned int getTeamCount() const;
+
+        /**
+         * @brief Add a unit to a team.
+         * @details Adding a unit twice has no effect.
+         * @param team Index of the team.
+         * @param unit Light with the sight of the unit.
+         */
+        void addUnit(unsigned int team, const LightSource* unit);
+
+        /**
+         * @brief Remove a unit.
+         * @param unit
+         */
+        void removeUnit(const LightSource* unit);
+
+        /**
+         * @brief Remove all the units.
+         */
+        void clearUnits();
+
+        /**
+         * @brief Get the number of units of all the teams.
+         */
+        size_t getUnitCount() const;
+
+        /**
+         * @brief Set the number of threads used by @ref update.
+         * @details Zero means one per hardware thread, which is the
+         * default.
+         * @param threads
+         */
+        void setThreadCount(unsigned int threads);
+
+        /**
+         * @brief Get the number of threads used by @ref update.
+         * @see setThreadCount
+         */
+        unsigned int getThreadCount() const;
+
+        /**
+         * @brief Compute the cells seen by every team from the current
+         * polygons of their units.
+         * @details The units must have been casted before. The result of the
+         * previous call is kept to find the newly revealed cells.
+         */
+        void update();
+
+        /**
+         * @brief Check if a team sees a cell.
+         * @param team Index of the team.
+         * @param x Column of the cell.
+         * @param y Row of the cell.
+         */
+        bool isVisible(unsigned int team, int x, int y) const;
+
+        /**
+         * @brief Check if a team sees a point of the world.
+         * @param team Index of the team.
+         * @param point Point in global coordinates.
+         */
+        bool isVisible(unsigned int team, const sf::Vector2f& point) const;
+
+        /**
+         * @brief Get the cells a team sees since the last update, that it
+         * didn't see in the previous one.
+         * @param team Index of the team.
+         * @param out Vector to append the column and row of the cells to.
+         */
+        void getNewlyRevealed(unsigned int team, std::vector<sf::Vector2u>& out) const;
+
+        /**
+         * @brief Get the cells seen by a team.
+         * @param team Index of the team.
+         */
+        const BitGrid& getGrid(unsigned int team) const;
+    };
+}
+
+#endif
@@ -0,0 +1,89 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the functions to record a timeline of Candle in
+ * the Chrome trace event format.
+ */
+#ifndef __CANDLE_TRACE_HPP__
+#define __CANDLE_TRACE_HPP__
+
+#include <cstdint>
+#include <string>
+
+namespace candle{
+    /**
+     * @brief Start recording a timeline to a file.
+     * @details While the recording is active, every @ref TraceZone that is
+     * constructed is registered as an event. The events are stored in a
+     * bounded ring buffer per thread, without locks, and written to the
+     * file in the Chrome trace event format (JSON) on every call to
+     * @ref flushTrace and @ref stopTrace. The file can be opened in
+     * [Perfetto](https://ui.perfetto.dev) or in chrome://tracing.
+     *
+     * Inside Candle, the zones are only compiled if the library is compiled
+     * with the macro CANDLE_TRACE defined (option CANDLE_TRACE in CMake).
+     *
+     * If a thread fills its buffer before the next flush, the new events of
+     * that thread are discarded. When a thread exits, its events are
+     * written and its buffer is reused by the next thread that records one,
+     * which also takes its thread id in the file.
+     *
+     * @param path Path of the file to write.
+     * @param eventsPerThread Capacity of the buffer of each thread.
+     * @returns False if the file could not be opened or a recording is
+     * already active.
+     * @see stopTrace, CANDLE_TRACE_ZONE
+     */
+    bool startTrace(const std::string& path, std::size_t eventsPerThread = 1 << 16);
+
+    /**
+     * @brief Write the events recorded so far to the file.
+     * @details It is intended to be called once per frame, from a single
+     * thread, to keep the buffers from filling up.
+     */
+    void flushTrace();
+
+    /**
+     * @brief Write the remaining events and close the file.
+     * @returns The number of events discarded because of full buffers.
+     */
+    std::uint64_t stopTrace();
+
+    /**
+     * @brief Check if there is an active recording.
+     */
+    bool isTracing();
+
+    /**
+     * @brief Scoped zone of the timeline.
+     * @details It records an event from its construction to its destruction,
+     * if there is an active recording. The name must outlive the recording,
+     * so it should be a string literal.
+     */
+    class TraceZone{
+    private:
+        const char* m_name;
+        std::int64_t m_start;
+    public:
+        TraceZone(const char* name);
+        ~TraceZone();
+        TraceZone(const TraceZone&) = delete;
+        TraceZone& operator=(const TraceZone&) = delete;
+    };
+}
+
+#ifdef CANDLE_TRACE
+    #define CANDLE_TRACE_CONCAT_(a, b) a##b
+    #define CANDLE_TRACE_CONCAT(a, b) CANDLE_TRACE_CONCAT_(a, b)
+    /**
+     * @brief Record the rest of the enclosing scope as a zone of the timeline.
+     * @details Expands to nothing unless CANDLE_TRACE is defined.
+     */
+    #define CANDLE_TRACE_ZONE(name) \
+        candle::TraceZone CANDLE_TRACE_CONCAT(candleTraceZone, __LINE__)(name)
+#else
+    #define CANDLE_TRACE_ZONE(name)
+#endif
+
+#endif
@@ -0,0 +1,80 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the Circle struct, used as a round occluder.
+ */
+#ifndef __SFML_UTIL_GEOMETRY_CIRCLE_HPP__
+#define __SFML_UTIL_GEOMETRY_CIRCLE_HPP__
+
+#include <vector>
+
+#include <SFML/System/Vector2.hpp>
+#include <SFML/Graphics/Rect.hpp>
+
+#include "Candle/geometry/Line.hpp"
+
+namespace sfu{
+    /**
+     * @brief 2D %Circle defined by its center and radius.
+     */
+    struct Circle{
+        sf::Vector2f m_center; ///< Center of the circle.
+        float m_radius; ///< Radius of the circle.
+
+        /**
+         * @brief Construct a circle.
+         * @param center
+         * @param radius
+         */
+        Circle(const sf::Vector2f& center, float radius);
+
+        /**
+         * @brief Get the bounding rectangle of the circle.
+         * @returns Bounding rectangle in float
+         */
+        sf::FloatRect getGlobalBounds() const;
+
+        /**
+         * @brief Check if a point is inside the circle.
+         * @param point
+         * @returns True if the point is inside or on the circle.
+         */
+        bool contains(const sf::Vector2f& point) const;
+
+        /**
+         * @brief Intersect a ray with the circle.
+         * @details The ray is casted from its origin in its direction, so
+         * only the hits with a non negative @p normA count. If the origin is
+         * inside the circle, the hit is where the ray leaves it.
+         * @param ray
+         * @param normA (Output argument) Magnitude required to get the
+         * closest hit from the origin of the ray, in units of its direction.
+         * @returns True, if there is an intersection.
+         */
+        bool intersection(const Line& ray, float& normA) const;
+
+        /**
+         * @brief Get the points where the tangents from a point touch the
+         * circle.
+         * @details @p t1 is rotated a negative angle from the direction from
+         * the point to the center, and @p t2 a positive one.
+         * @param point Point out of the circle.
+         * @param t1 (Output argument)
+         * @param t2 (Output argument)
+         * @returns False if the point is inside the circle.
+         */
+        bool tangents(const sf::Vector2f& point, sf::Vector2f& t1, sf::Vector2f& t2) const;
+
+        /**
+         * @brief Approximate the circle with a regular polygon.
+         * @details The polygon is circumscribed, so it covers the whole
+         * circle.
+         * @param out Vector to append the sides to.
+         * @param sides Number of sides.
+         */
+        void polygonize(std::vector<Line>& out, unsigned int sides = 16) const;
+    };
+}
+
+#endif
@@ -0,0 +1,337 @@
+#include "Candle/BitGrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Candle/Parallel.hpp"
+#include "Candle/Trace.hpp"
+
+namespace candle{
+    const std::uint64_t FULL_WORD = ~std::uint64_t(0);
+    // Minimum number of rows given to each thread
+    const size_t PARALLEL_MIN_GRID_ROWS = 32;
+
+    // Number of bits set in a word, adding them in parallel inside the word
+    unsigned int popCount(std::uint64_t w){
+        w = w - ((w >> 1) & 0x5555555555555555ull);
+        w = (w & 0x3333333333333333ull) + ((w >> 2) & 0x3333333333333333ull);
+        w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0full;
+        return (w * 0x0101010101010101ull) >> 56;
+    }
+
+    // Edge of a polygon being rasterized, in cell coordinates
+    struct ScanEdge{
+        int firstRow;
+        int lastRow; // past the last one
+        float x; // at the center of the first row
+        float slope;
+    };
+
+    // Clamp a coordinate in cells before converting it to int, as the
+    // vertices of the lights may be very far out of the grid
+    float clampCells(float v, float low, float high){
+        return std::min(std::max(v, low), high);
+    }
+
+    BitGrid::BitGrid()
+        : m_cellSize(1.f)
+        , m_width(0)
+        , m_height(0)
+        , m_rowWords(0)
+        {}
+
+    BitGrid::BitGrid(const sf::FloatRect& area, float cellSize){
+        reset(area, cellSize);
+    }
+
+    void BitGrid::reset(const sf::FloatRect& area, float cellSize){
+        m_area = area;
+        m_cellSize = cellSize;
+        m_width = std::max(0.f, std::ceil(area.size.x / cellSize));
+        m_height = std::max(0.f, std::ceil(area.size.y / cellSize));
+        m_rowWords = (m_width + 63) / 64;
+        m_words.assign(m_rowWords * m_height, 0);
+    }
+
+    const sf::FloatRect& BitGrid::getArea() const{
+        return m_area;
+    }
+
+    float BitGrid::getCellSize() const{
+        return m_cellSize;
+    }
+
+    unsigned int BitGrid::getWidth() const{
+        return m_width;
+    }
+
+    unsigned int BitGrid::getHeight() const{
+        return m_height;
+    }
+
+    sf::Vector2i BitGrid::getCell(const sf::Vector2f& point) const{
+        sf::Vector2f cell = (point - m_area.position) / m_cellSize;
+        return {
+            (int)std::floor(clampCells(cell.x, -1.f, m_width)),
+            (int)std::floor(clampCells(cell.y, -1.f, m_height))
+        };
+    }
+
+    bool BitGrid::get(int x, int y) const{
+        if(x < 0 || y < 0 || x >= (int)m_width || y >= (int)m_height){
+            return false;
+        }
+        return (m_words[y * m_rowWords + x / 64] >> (x % 64)) & 1;
+    }
+
+    bool BitGrid::contains(const sf::Vector2f& point) const{
+        sf::Vector2i cell = getCell(point);
+        return get(cell.x, cell.y);
+    }
+
+    void BitGrid::set(unsigned int x, unsigned int y, bool value){
+        std::uint64_t& w = m_words[y * m_rowWords + x / 64];
+        std::uint64_t bit = std::uint64_t(1) << (x % 64);
+        w = value ? w | bit : w & ~bit;
+    }
+
+    void BitGrid::fillSpan(unsigned int y, unsigned int x0, unsigned int x1){
+        if(x0 >= x1){
+            return;
+        }
+        std::uint64_t* row = &m_words[y * m_rowWords];
+        size_t w0 = x0 / 64;
+        size_t w1 = (x1 - 1) / 64;
+        std::uint64_t first = FULL_WORD << (x0 % 64);
+        std::uint64_t last = FULL_WORD >> (63 - (x1 - 1) % 64);
+        if(w0 == w1){
+            row[w0] |= first & last;
+            return;
+        }
+        row[w0] |= first;
+        std::fill(row + w0 + 1, row + w1, FULL_WORD);
+        row[w1] |= last;
+    }
+
+    void BitGrid::fillPolygon(const sf::Vector2f* points, size_t count, unsigned int rowBegin, unsigned int rowEnd){
+        fill(points, count, rowBegin, rowEnd, sf::Vector2f(), 0.f);
+    }
+
+    void BitGrid::fill(const sf::Vector2f* points, size_t count, unsigned int rowBegin, unsigned int rowEnd,
+                       const sf::Vector2f& clipCenter, float clipRadius){
+        rowEnd = std::min(rowEnd, m_height);
+        if(count < 3 || m_width == 0 || rowBegin >= rowEnd){
+            return;
+        }
+        // the row y is crossed by the edges with yMin <= y + 0.5 < yMax
+        std::vector<ScanEdge> edges;
+        edges.reserve(count);
+        for(size_t i = 0; i < count; i++){
+            sf::Vector2f a = (points[i] - m_area.position) / m_cellSize;
+            sf::Vector2f b = (points[(i + 1) % count] - m_area.position) / m_cellSize;
+            if(a.y > b.y){
+                std::swap(a, b);
+            }
+            int firstRow = std::ceil(clampCells(a.y - 0.5f, rowBegin, rowEnd));
+            int lastRow = std::ceil(clampCells(b.y - 0.5f, rowBegin, rowEnd));
+            if(firstRow >= lastRow){
+                continue;
+            }
+            float slope = (b.x - a.x) / (b.y - a.y);
+            edges.push_back({ firstRow, lastRow, a.x + (firstRow + 0.5f - a.y) * slope, slope });
+        }
+        if(edges.empty()){
+            return;
+        }
+        std::sort(edges.begin(), edges.end(), [] (const ScanEdge& a, const ScanEdge& b){
+            return a.firstRow < b.firstRow;
+        });
+
+        std::vector<ScanEdge> active;
+        std::vector<float> crossings;
+        size_t next = 0;
+        for(int y = edges[0].firstRow; next < edges.size() || !active.empty(); y++){
+            if(active.empty()){
+                y = std::max(y, edges[next].firstRow);
+            }
+            while(next < edges.size() && edges[next].firstRow == y){
+                active.push_back(edges[next++]);
+            }
+            crossings.clear();
+            for(auto& e: active){
+                crossings.push_back(e.x);
+                e.x += e.slope;
+            }
+            std::sort(crossings.begin(), crossings.end());
+            float clipLeft = 0.f, clipRight = m_width;
+            if(clipRadius > 0.f){
+                // part of the row inside the circle
+                sf::Vector2f center = (clipCenter - m_area.position) / m_cellSize;
+                float radius = clipRadius / m_cellSize;
+                float dy = y + 0.5f - center.y;
+                float half = radius * radius - dy * dy > 0.f ? std::sqrt(radius * radius - dy * dy) : 0.f;
+                clipLeft = std::max(clipLeft, center.x - half);
+                clipRight = std::min(clipRight, center.x + half);
+            }
+            for(size_t i = 0; i + 1 < crossings.size(); i += 2){
+                // cells whose center is in [x0, x1)
+                float x0 = std::ceil(clampCells(std::max(clipLeft, crossings[i]), 0.f, m_width) - 0.5f);
+                float x1 = std::ceil(clampCells(std::min(clipRight, crossings[i + 1]), 0.f, m_width) - 0.5f);
+                if(x0 < x1){
+                    fillSpan(y, x0, x1);
+                }
+            }
+            active.erase(
+                std::remove_if(active.begin(), active.end(), [y] (const ScanEdge& e){
+                    return e.lastRow <= y + 1;
+                }),
+                active.end()
+            );
+        }
+    }
+
+    void BitGrid::fillLight(const LightSource& light, unsigned int rowBegin, unsigned int rowEnd){
+        PolygonView polygon = light.getGlobalPolygon();
+        std::vector<sf::Vector2f> points(polygon.begin(), polygon.end());
+        size_t n = points.size();
+        switch(polygon.getPrimitiveType()){
+            case sf::PrimitiveType::TriangleStrip:
+                for(size_t i = 0; i + 2 < n; i++){
+                    fillPolygon(&points[i], 3, rowBegin, rowEnd);
+                }
+                break;
+            case sf::PrimitiveType::Triangles:
+                for(size_t i = 0; i + 2 < n; i += 3){
+                    fillPolygon(&points[i], 3, rowBegin, rowEnd);
+                }
+                break;
+            case sf::PrimitiveType::TriangleFan:
+                // the fans are star-shaped from their first vertex, so their
+                // outline is the polygon of their vertices, but the rays that
+                // don't hit anything go beyond the range
+                if(n > 0){
+                    float scale = std::max(std::abs(light.getScale().x), std::abs(light.getScale().y));
+                    fill(points.data(), n, rowBegin, rowEnd, points[0], light.getRange() * scale);
+                }
+                break;
+            default:
+                fillPolygon(points.data(), n, rowBegin, rowEnd);
+                break;
+        }
+    }
+
+    void BitGrid::fillLights(const std::vector<const LightSource*>& lights, unsigned int threads){
+        fillLights(lights, std::vector<BitGrid*>(lights.size(), this), threads);
+    }
+
+    void BitGrid::fillLights(const std::vector<const LightSource*>& lights,
+                             const std::vector<BitGrid*>& grids, unsigned int threads){
+        CANDLE_TRACE_ZONE("BitGrid::fillLights");
+        if(lights.empty()){
+            return;
+        }
+        const BitGrid& layout = *grids[0];
+        // rows reached by the polygon of every light, clipped to the grid;
+        // the fans are also clipped to the range, as their rays go beyond it
+        std::vector<std::pair<int, int>> rows(lights.size());
+        for(size_t i = 0; i < lights.size(); i++){
+            PolygonView polygon = lights[i]->getGlobalPolygon();
+            sf::FloatRect bounds = polygon.getBounds();
+            float top = bounds.position.y, bottom = bounds.position.y + bounds.size.y;
+            if(polygon.getPrimitiveType() == sf::PrimitiveType::TriangleFan && polygon.size() > 0){
+                const sf::Vector2f& scale = lights[i]->getScale();
+                float range = lights[i]->getRange() * std::max(std::abs(scale.x), std::abs(scale.y));
+                float center = polygon[0].y;
+                top = std::max(top, center - range);
+                bottom = std::min(bottom, center + range);
+            }
+            top = (top - layout.m_area.position.y) / layout.m_cellSize;
+            bottom = (bottom - layout.m_area.position.y) / layout.m_cellSize;
+            rows[i].first = std::floor(clampCells(top, 0.f, layout.m_height));
+            rows[i].second = std::ceil(clampCells(bottom + 1.f, 0.f, layout.m_height));
+        }
+        parallelFor(layout.m_height, threads, PARALLEL_MIN_GRID_ROWS,
+            [&] (size_t b, size_t e, unsigned int){
+                for(size_t i = 0; i < lights.size(); i++){
+                    int rowBegin = std::max(rows[i].first, (int)b);
+                    int rowEnd = std::min(rows[i].second, (int)e);
+                    if(rowBegin < rowEnd){
+                        grids[i]->fillLight(*lights[i], rowBegin, rowEnd);
+                    }
+                }
+            }
+        );
+    }
+
+    void BitGrid::clear(){
+        std::fill(m_words.begin(), m_words.end(), 0);
+    }
+
+    void BitGrid::merge(const BitGrid& other){
+        for(size_t i = 0; i < m_words.size(); i++){
+            m_words[i] |= other.m_words[i];
+        }
+    }
+
+    void BitGrid::subtract(const BitGrid& other){
+        for(size_t i = 0; i < m_words.size(); i++){
+            m_words[i] &= ~other.m_words[i];
+        }
+    }
+
+    size_t BitGrid::count() const{
+        size_t n = 0;
+        for(std::uint64_t w: m_words){
+            n += popCount(w);
+        }
+        return n;
+    }
+
+    float BitGrid::getCoveredArea() const{
+        return count() * m_cellSize * m_cellSize;
+    }
+
+    bool BitGrid::intersects(const sf::FloatRect& area) const{
+        sf::Vector2f a = (area.position - m_area.position) / m_cellSize;
+        sf::Vector2f b = a + area.size / m_cellSize;
+        if(m_width == 0 || b.x < 0.f || b.y < 0.f || a.x >= m_width || a.y >= m_height){
+            return false;
+        }
+        unsigned int x0 = std::max(a.x, 0.f), y0 = std::max(a.y, 0.f);
+        unsigned int x1 = std::min<float>(b.x, m_width - 1), y1 = std::min<float>(b.y, m_height - 1);
+        size_t w0 = x0 / 64, w1 = x1 / 64;
+        std::uint64_t first = FULL_WORD << (x0 % 64);
+        std::uint64_t last = FULL_WORD >> (63 - x1 % 64);
+        for(unsigned int y = y0; y <= y1; y++){
+            const std::uint64_t* row = &m_words[y * m_rowWords];
+            for(size_t w = w0; w <= w1; w++){
+                std::uint64_t mask = (w == w0 ? first : FULL_WORD) & (w == w1 ? last : FULL_WORD);
+                if(row[w] & mask){
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void BitGrid::getCells(std::vector<sf::Vector2u>& out) const{
+        for(unsigned int y = 0; y < m_height; y++){
+            for(size_t j = 0; j < m_rowWords; j++){
+                std::uint64_t w = m_words[y * m_rowWords + j];
+                while(w != 0){
+                    std::uint64_t lowest = w & (~w + 1);
+                    out.emplace_back(unsigned(j * 64 + popCount(lowest - 1)), y);
+                    w ^= lowest;
+                }
+            }
+        }
+    }
+
+    size_t BitGrid::getRowWords() const{
+        return m_rowWords;
+    }
+
+    const std::vector<std::uint64_t>& BitGrid::getWords() const{
+        return m_words;
+    }
+}
@@ -0,0 +1,77 @@
+#include <cmath>
+
+#include "Candle/geometry/Circle.hpp"
+#include "Candle/geometry/Vector2.hpp"
+
+namespace sfu{
+    Circle::Circle(const sf::Vector2f& center, float radius):
+        m_center(center),
+        m_radius(radius){}
+
+    sf::FloatRect Circle::getGlobalBounds() const{
+        return sf::FloatRect(
+            { m_center.x - m_radius, m_center.y - m_radius },
+            { 2 * m_radius, 2 * m_radius }
+        );
+    }
+
+    bool Circle::contains(const sf::Vector2f& point) const{
+        return magnitude2(point - m_center) <= m_radius * m_radius;
+    }
+
+    bool Circle::intersection(const Line& ray, float& normA) const{
+        // |o + t*d|^2 = r^2, relative to the center
+        sf::Vector2f o = ray.m_origin - m_center;
+        const sf::Vector2f& d = ray.m_direction;
+        float a = magnitude2(d);
+        float b = dot(o, d);
+        // b^2 - a*(|o|^2 - r^2), written without the cancellation of b^2
+        // and a*|o|^2, which loses the rays that graze a far circle
+        float side = o.cross(d);
+        float disc = a * m_radius * m_radius - side * side;
+        if(a == 0.f || disc < 0.f){
+            return false;
+        }
+        float root = std::sqrt(disc);
+        float t = (-b - root) / a;
+        if(t < 0.f){
+            t = (-b + root) / a;
+        }
+        if(t < 0.f){
+            return false;
+        }
+        normA = t;
+        return true;
+    }
+
+    bool Circle::tangents(const sf::Vector2f& point, sf::Vector2f& t1, sf::Vector2f& t2) const{
+        sf::Vector2f d = m_center - point;
+        float dist2 = magnitude2(d);
+        float r2 = m_radius * m_radius;
+        if(dist2 <= r2){
+            return false;
+        }
+        // the tangent points are at distance sqrt(dist2 - r2) from the point,
+        // rotated asin(r / dist) from the direction to the center
+        float side = std::sqrt(dist2 - r2);
+        float cosA = side / std::sqrt(dist2);
+        float sinA = m_radius / std::sqrt(dist2);
+        sf::Vector2f u = d / std::sqrt(dist2) * side;
+        t1 = point + sf::Vector2f(u.x * cosA + u.y * sinA, -u.x * sinA + u.y * cosA);
+        t2 = point + sf::Vector2f(u.x * cosA - u.y * sinA, u.x * sinA + u.y * cosA);
+        return true;
+    }
+
+    void Circle::polygonize(std::vector<Line>& out, unsigned int sides) const{
+        if(sides < 3){
+            sides = 3;
+        }
+        float step = 2 * PI / sides;
+        float r = m_radius / std::cos(step / 2);
+        for(unsigned int i = 0; i < sides; i++){
+            sf::Vector2f a = m_center + r * sf::Vector2f(std::cos(step * i), std::sin(step * i));
+            sf::Vector2f b = m_center + r * sf::Vector2f(std::cos(step * (i + 1)), std::sin(step * (i + 1)));
+            out.emplace_back(a, b);
+        }
+    }
+}
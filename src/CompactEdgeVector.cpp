@@ -0,0 +1,218 @@
+#include "Candle/CompactEdgeVector.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace candle{
+    const float QUANTIZATION_STEPS = 32767.f;
+
+    std::int16_t quantize(float x, float origin, float scale){
+        float q = std::round((x - origin) / scale);
+        return (std::int16_t)std::max(-QUANTIZATION_STEPS, std::min(QUANTIZATION_STEPS, q));
+    }
+
+    CompactEdgeVector::const_iterator::const_iterator(const CompactEdgeVector* v, size_t index, size_t chunk)
+        : m_vector(v)
+        , m_index(index)
+        , m_chunk(chunk)
+        , m_culled(false)
+    {
+        skipChunks();
+    }
+
+    CompactEdgeVector::const_iterator::const_iterator(const CompactEdgeVector* v, size_t index, size_t chunk, const sf::FloatRect& area)
+        : m_vector(v)
+        , m_index(index)
+        , m_chunk(chunk)
+        , m_area(area)
+        , m_culled(true)
+    {
+        skipChunks();
+    }
+
+    void CompactEdgeVector::const_iterator::skipChunks(){
+        // the chunks are contiguous, so skipping one is moving to its end
+        const auto& chunks = m_vector->m_chunks;
+        while(m_chunk < chunks.size()
+              && (m_index >= chunks[m_chunk].end
+                  || (m_culled && !chunks[m_chunk].bounds.findIntersection(m_area)))){
+            m_index = std::max(m_index, chunks[m_chunk].end);
+            m_chunk++;
+        }
+    }
+
+    sfu::Line CompactEdgeVector::const_iterator::operator*() const{
+        return m_vector->decode(m_chunk, m_index);
+    }
+
+    CompactEdgeVector::const_iterator::Proxy CompactEdgeVector::const_iterator::operator->() const{
+        return Proxy{ m_vector->decode(m_chunk, m_index) };
+    }
+
+    CompactEdgeVector::const_iterator& CompactEdgeVector::const_iterator::operator++(){
+        m_index++;
+        if(m_index >= m_vector->m_chunks[m_chunk].end){
+            skipChunks();
+        }
+        return *this;
+    }
+
+    CompactEdgeVector::const_iterator CompactEdgeVector::const_iterator::operator++(int){
+        const_iterator it = *this;
+        ++(*this);
+        return it;
+    }
+
+    bool CompactEdgeVector::const_iterator::operator==(const const_iterator& other) const{
+        return m_index == other.m_index;
+    }
+
+    bool CompactEdgeVector::const_iterator::operator!=(const const_iterator& other) const{
+        return m_index != other.m_index;
+    }
+
+    CompactEdgeVector::CompactEdgeVector(float chunkSize)
+        : m_chunkSize(chunkSize)
+        {}
+
+    void CompactEdgeVector::assign(const std::vector<sfu::Line>& edges){
+        clear();
+        // group the edges by the chunk of their middle point
+        std::vector<std::pair<long long, long long>> keys(edges.size());
+        for(size_t i = 0; i < edges.size(); i++){
+            sf::Vector2f mid = edges[i].point(.5f);
+            keys[i] = { (long long)std::floor(mid.x / m_chunkSize), (long long)std::floor(mid.y / m_chunkSize) };
+        }
+        std::vector<size_t> order(edges.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(
+            order.begin(),
+            order.end(),
+            [&keys] (size_t a, size_t b){ return keys[a] < keys[b]; }
+        );
+
+        m_edges.reserve(edges.size());
+        for(size_t first = 0; first < order.size(); ){
+            size_t last = first;
+            while(last < order.size() && keys[order[last]] == keys[order[first]]){
+                last++;
+            }
+            // the scale is the smallest one that fits every endpoint
+            sf::Vector2f low = edges[order[first]].m_origin, high = low;
+            for(size_t i = first; i < last; i++){
+                const sfu::Line& e = edges[order[i]];
+                for(sf::Vector2f p: { e.m_origin, e.point(1.f) }){
+                    low = { std::min(low.x, p.x), std::min(low.y, p.y) };
+                    high = { std::max(high.x, p.x), std::max(high.y, p.y) };
+                }
+            }
+            // The scale is a power of two and the origin a multiple of it, so
+            // the points of the grid of the scale (e.g. integer coordinates,
+            // if the scale is smaller than one) are decoded exactly
+            Chunk chunk;
+            float extent = std::max(high.x - low.x, high.y - low.y) / 2.f;
+            chunk.scale = std::exp2(std::ceil(std::log2(std::max(extent, 1e-3f) / QUANTIZATION_STEPS)));
+            for(;;){
+                sf::Vector2f center = (low + high) / 2.f;
+                chunk.origin = {
+                    std::round(center.x / chunk.scale) * chunk.scale,
+                    std::round(center.y / chunk.scale) * chunk.scale
+                };
+                float reach = std::max({ chunk.origin.x - low.x, high.x - chunk.origin.x,
+                                         chunk.origin.y - low.y, high.y - chunk.origin.y });
+                if(reach <= QUANTIZATION_STEPS * chunk.scale){
+                    break;
+                }
+                chunk.scale *= 2.f;
+            }
+            chunk.begin = m_edges.size();
+            for(size_t i = first; i < last; i++){
+                const sfu::Line& e = edges[order[i]];
+                sf::Vector2f p2 = e.point(1.f);
+                m_edges.push_back({
+                    quantize(e.m_origin.x, chunk.origin.x, chunk.scale),
+                    quantize(e.m_origin.y, chunk.origin.y, chunk.scale),
+                    quantize(p2.x, chunk.origin.x, chunk.scale),
+                    quantize(p2.y, chunk.origin.y, chunk.scale)
+                });
+            }
+            chunk.end = m_edges.size();
+            // +1 to avoid bounds of width zero, as in sfu::Line
+            chunk.bounds = sf::FloatRect(low - sf::Vector2f(chunk.scale, chunk.scale),
+                high - low + sf::Vector2f(2 * chunk.scale + 1.f, 2 * chunk.scale + 1.f));
+            m_chunks.push_back(chunk);
+            first = last;
+        }
+    }
+
+    void CompactEdgeVector::clear(){
+        m_edges.clear();
+        m_chunks.clear();
+    }
+
+    size_t CompactEdgeVector::size() const{
+        return m_edges.size();
+    }
+
+    bool CompactEdgeVector::empty() const{
+        return m_edges.empty();
+    }
+
+    float CompactEdgeVector::getChunkSize() const{
+        return m_chunkSize;
+    }
+
+    const std::vector<CompactEdgeVector::Chunk>& CompactEdgeVector::getChunks() const{
+        return m_chunks;
+    }
+
+    const std::vector<CompactEdgeVector::CompactEdge>& CompactEdgeVector::getCompactEdges() const{
+        return m_edges;
+    }
+
+    sfu::Line CompactEdgeVector::decode(size_t chunk, size_t index) const{
+        return decode(m_chunks[chunk], m_edges[index]);
+    }
+
+    sfu::Line CompactEdgeVector::decode(const Chunk& c, const CompactEdge& e){
+        return sfu::Line(
+            { c.origin.x + e.x1 * c.scale, c.origin.y + e.y1 * c.scale },
+            { c.origin.x + e.x2 * c.scale, c.origin.y + e.y2 * c.scale }
+        );
+    }
+
+    void CompactEdgeVector::decode(const sf::FloatRect& area, std::vector<sfu::Line>& out) const{
+        for(size_t c = 0; c < m_chunks.size(); c++){
+            if(m_chunks[c].bounds.findIntersection(area)){
+                for(size_t i = m_chunks[c].begin; i < m_chunks[c].end; i++){
+                    out.push_back(decode(c, i));
+                }
+            }
+        }
+    }
+
+    float CompactEdgeVector::getMaxError() const{
+        float scale = 0.f;
+        for(auto& c: m_chunks){
+            scale = std::max(scale, c.scale);
+        }
+        return scale * std::sqrt(2.f) / 2.f;
+    }
+
+    size_t CompactEdgeVector::getMemoryUsage() const{
+        return m_edges.size() * sizeof(CompactEdge) + m_chunks.size() * sizeof(Chunk);
+    }
+
+    CompactEdgeVector::const_iterator CompactEdgeVector::begin() const{
+        return const_iterator(this, 0, 0);
+    }
+
+    CompactEdgeVector::const_iterator CompactEdgeVector::begin(const sf::FloatRect& area) const{
+        return const_iterator(this, 0, 0, area);
+    }
+
+    CompactEdgeVector::const_iterator CompactEdgeVector::end() const{
+        return const_iterator(this, m_edges.size(), m_chunks.size());
+    }
+}
@@ -3,3 +3,9 @@
 namespace sfu{
     const float PI = 3.1415926f;
 }
+
+namespace candle{
+    long long cellKey(long long x, long long y){
+        return (long long)((unsigned long long)x << 32) ^ (y & 0xffffffffLL);
+    }
+}
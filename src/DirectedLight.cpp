@@ -5,14 +5,18 @@
 #include "Candle/geometry/Vector2.hpp"
 #include "Candle/geometry/Line.hpp"
 #include "Candle/graphics/VertexArray.hpp"
+#include "Candle/Trace.hpp"
 
 namespace candle{
     void DirectedLight::draw(sf::RenderTarget& t, sf::RenderStates st) const{
-        st.transform *= Transformable::getTransform();
+        if(!isVisible(t.getView(), st.transform)){
+            return;
+        }
+        st.transform *= getDrawTransform();
         if(st.blendMode == sf::BlendAlpha){ // the default
             st.blendMode = sf::BlendAdd;
         }
-        t.draw(m_polygon, st);
+        drawGeometry(t, st, m_polygon, m_polygonCache);
 #ifdef CANDLE_DEBUG
         sf::RenderStates deb_s;
         deb_s.transform = st.transform;
@@ -35,12 +39,16 @@ namespace candle{
             float dr1 = 1.f - m_fade * (sfu::magnitude(r2-r1) / m_range);
             float dr2 = 1.f - m_fade * (sfu::magnitude(r4-r3) / m_range);
             m_polygon[p1].color = m_polygon[p2].color =
-                m_polygon[p3].color = m_polygon[p4].color = m_color;
-            m_polygon[p2].color.a = m_color.a * dr1;
-            m_polygon[p4].color.a = m_color.a * dr2;
+                m_polygon[p3].color = m_polygon[p4].color = sf::Color::White;
+            m_polygon[p2].color.a = 255 * dr1;
+            m_polygon[p4].color.a = 255 * dr2;
         }
     }
 
+    std::unique_ptr<LightSource> DirectedLight::clone() const{
+        return std::make_unique<DirectedLight>(*this);
+    }
+
     DirectedLight::DirectedLight(){
         m_polygon.setPrimitiveType(sf::PrimitiveType::TriangleStrip);
         m_polygon.resize(2);
@@ -56,6 +64,14 @@ namespace candle{
         return m_beamWidth;
     }
 
+    sf::FloatRect DirectedLight::getLocalBounds() const{
+        return sf::FloatRect({ 0.f, -m_beamWidth / 2.f }, { m_range, m_beamWidth });
+    }
+
+    sf::FloatRect DirectedLight::getGlobalBounds() const{
+        return Transformable::getTransform().transformRect( getLocalBounds() );
+    }
+
     struct LineParam: public sfu::Line{
         float param;
         LineParam(float f, const sfu::Line& l)
@@ -69,6 +85,24 @@ namespace candle{
         return a.param < b.param;
     }
     void DirectedLight::castLight(const EdgeVector::iterator& begin, const EdgeVector::iterator& end){
+        cast(begin, end);
+    }
+
+    void DirectedLight::castLight(const CompactEdgeVector::const_iterator& begin,
+                                  const CompactEdgeVector::const_iterator& end){
+        cast(begin, end);
+    }
+
+    template <typename Iterator>
+    void DirectedLight::cast(const Iterator& begin, const Iterator& end){
+        CANDLE_TRACE_ZONE("DirectedLight::castLight");
+#ifdef CANDLE_STATISTICS
+        sf::Clock clock;
+        CastStatistics stats;
+        stats.casts = 1;
+        stats.edgesConsidered = std::distance(begin, end);
+#endif
+        m_castTransform.reset();
         sf::Transform trm = Transformable::getTransform();
         sf::Transform trm_i = trm.getInverse();
 
@@ -93,7 +127,10 @@ namespace candle{
         rays.emplace(0.f, lim1);
         rays.emplace(1.f, lim2);
         for(auto it = begin; it != end; it++){
-            auto& seg = *it;
+            const sfu::Line& seg = *it;
+#ifdef CANDLE_STATISTICS
+            size_t raysBefore = rays.size();
+#endif
             float tRng, tSeg;
             if(
                 rayRng.intersection(seg, tRng, tSeg)
@@ -119,7 +156,16 @@ namespace candle{
                 rays.emplace(raySrc.point(t), lightDir, t);
                 rays.emplace(raySrc.point(t + off), lightDir, t + off);
             }
+#ifdef CANDLE_STATISTICS
+            if(rays.size() == raysBefore){
+                stats.edgesCulled++;
+            }
+#endif
         }
+#ifdef CANDLE_STATISTICS
+        stats.raysGenerated = rays.size();
+        stats.intersectionTests = rays.size() * stats.edgesConsidered;
+#endif
         std::vector<sf::Vector2f> points;
         points.reserve(rays.size()*2);
 #ifdef CANDLE_DEBUG
@@ -134,18 +180,21 @@ namespace candle{
         m_debug[deb_r-3].position = {m_range, -widthHalf};
         m_debug[deb_r-4].position = {m_range, widthHalf};
 #endif
-        while(!rays.empty()){
-            LineParam r = rays.top();
-
-            sf::Vector2f p1 = trm_i.transformPoint(r.m_origin);
-            sf::Vector2f p2 = trm_i.transformPoint(sfu::castRay(begin, end, r, m_range));
-            points.push_back(p1);
-            points.push_back(p2);
+        {
+            CANDLE_TRACE_ZONE("DirectedLight::castRays");
+            while(!rays.empty()){
+                LineParam r = rays.top();
+
+                sf::Vector2f p1 = trm_i.transformPoint(r.m_origin);
+                sf::Vector2f p2 = trm_i.transformPoint(sfu::castRay(begin, end, r, m_range));
+                points.push_back(p1);
+                points.push_back(p2);
 #ifdef CANDLE_DEBUG
-            m_debug[i++].position = p1;
-            m_debug[i++].position = p2;
+                m_debug[i++].position = p1;
+                m_debug[i++].position = p2;
 #endif
-            rays.pop();
+                rays.pop();
+            }
         }
         if(!points.empty()){
             int quads = points.size()/2-1; // a quad between every two rays
@@ -162,11 +211,18 @@ namespace candle{
 
                 float dr1 = 1.f - m_fade * (sfu::magnitude(points[r2]-points[r1]) / m_range);
                 float dr2 = 1.f - m_fade * (sfu::magnitude(points[r4]-points[r3]) / m_range);
-                m_polygon[p1].color = m_polygon[p4].color = m_color;
-                m_polygon[p2].color = m_polygon[p3].color = m_color;
-                m_polygon[p2].color.a = m_color.a * dr1;
-                m_polygon[p4].color.a = m_color.a * dr2;
+                m_polygon[p1].color = m_polygon[p4].color = sf::Color::White;
+                m_polygon[p2].color = m_polygon[p3].color = sf::Color::White;
+                m_polygon[p2].color.a = 255 * dr1;
+                m_polygon[p4].color.a = 255 * dr2;
             }
         }
+        m_geometryVersion++;
+#ifdef CANDLE_STATISTICS
+        stats.polygonVertices = m_polygon.getVertexCount();
+        stats.castTime = clock.getElapsedTime();
+        m_stats += stats;
+        addFrameStatistics(stats);
+#endif
     }
 }
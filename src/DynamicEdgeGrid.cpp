@@ -0,0 +1,181 @@
+#include "Candle/DynamicEdgeGrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "Candle/Constants.hpp"
+#include "Candle/LightScheduler.hpp"
+
+namespace candle{
+    // Cell of the edges longer than the cells, which are kept apart
+    const long long LONG_EDGES_CELL = std::numeric_limits<long long>::min();
+
+    DynamicEdgeGrid::DynamicEdgeGrid(float cellSize)
+        : m_cellSize(cellSize)
+        , m_size(0)
+        , m_scheduler(nullptr)
+        {}
+
+    long long DynamicEdgeGrid::cellOf(const sfu::Line& edge) const{
+        sf::Vector2f half = edge.m_direction / 2.f;
+        if(std::max(std::abs(half.x), std::abs(half.y)) > m_cellSize){
+            return LONG_EDGES_CELL;
+        }
+        sf::Vector2f center = edge.m_origin + half;
+        return cellKey(std::floor(center.x / m_cellSize), std::floor(center.y / m_cellSize));
+    }
+
+    std::vector<DynamicEdgeGrid::Handle>& DynamicEdgeGrid::bucket(long long cell){
+        return cell == LONG_EDGES_CELL ? m_long : m_cells[cell];
+    }
+
+    void DynamicEdgeGrid::link(Handle handle){
+        Slot& slot = m_slots[handle];
+        slot.cell = cellOf(slot.edge);
+        auto& b = bucket(slot.cell);
+        slot.index = b.size();
+        b.push_back(handle);
+    }
+
+    void DynamicEdgeGrid::unlink(Handle handle){
+        Slot& slot = m_slots[handle];
+        auto& b = bucket(slot.cell);
+        // the last edge of the cell takes the place of this one
+        Handle last = b.back();
+        b[slot.index] = last;
+        m_slots[last].index = slot.index;
+        b.pop_back();
+        if(b.empty() && slot.cell != LONG_EDGES_CELL){
+            m_cells.erase(slot.cell);
+        }
+    }
+
+    void DynamicEdgeGrid::changed(const sf::FloatRect& area){
+        if(m_scheduler != nullptr){
+            m_scheduler->markDirty(area);
+        }
+    }
+
+    DynamicEdgeGrid::Handle DynamicEdgeGrid::insert(const sfu::Line& edge){
+        Handle handle;
+        if(m_free.empty()){
+            handle = m_slots.size();
+            m_slots.push_back({ edge, 0, 0, true });
+        }else{
+            handle = m_free.back();
+            m_free.pop_back();
+            m_slots[handle] = { edge, 0, 0, true };
+        }
+        link(handle);
+        m_size++;
+        changed(edge.getGlobalBounds());
+        return handle;
+    }
+
+    bool DynamicEdgeGrid::update(Handle handle, const sfu::Line& edge){
+        if(!contains(handle)){
+            return false;
+        }
+        Slot& slot = m_slots[handle];
+        // a single pass over the lights, with the bounds of both edges
+        sf::FloatRect a = slot.edge.getGlobalBounds();
+        sf::FloatRect b = edge.getGlobalBounds();
+        sf::Vector2f low(std::min(a.position.x, b.position.x), std::min(a.position.y, b.position.y));
+        sf::Vector2f high(std::max(a.position.x + a.size.x, b.position.x + b.size.x),
+                          std::max(a.position.y + a.size.y, b.position.y + b.size.y));
+        changed(sf::FloatRect(low, high - low));
+        if(cellOf(edge) == slot.cell){
+            slot.edge = edge;
+        }else{
+            unlink(handle);
+            slot.edge = edge;
+            link(handle);
+        }
+        return true;
+    }
+
+    bool DynamicEdgeGrid::remove(Handle handle){
+        if(!contains(handle)){
+            return false;
+        }
+        changed(m_slots[handle].edge.getGlobalBounds());
+        unlink(handle);
+        m_slots[handle].used = false;
+        m_free.push_back(handle);
+        m_size--;
+        return true;
+    }
+
+    bool DynamicEdgeGrid::contains(Handle handle) const{
+        return handle < m_slots.size() && m_slots[handle].used;
+    }
+
+    const sfu::Line& DynamicEdgeGrid::get(Handle handle) const{
+        return m_slots[handle].edge;
+    }
+
+    size_t DynamicEdgeGrid::size() const{
+        return m_size;
+    }
+
+    void DynamicEdgeGrid::clear(){
+        m_slots.clear();
+        m_free.clear();
+        m_cells.clear();
+        m_long.clear();
+        m_size = 0;
+        if(m_scheduler != nullptr){
+            m_scheduler->markAllDirty();
+        }
+    }
+
+    float DynamicEdgeGrid::getCellSize() const{
+        return m_cellSize;
+    }
+
+    void DynamicEdgeGrid::query(const sf::FloatRect& area, EdgeVector& out) const{
+        // the edges stick out of their cell up to one cell
+        long long x0 = std::floor(area.position.x / m_cellSize) - 1;
+        long long x1 = std::floor((area.position.x + area.size.x) / m_cellSize) + 1;
+        long long y0 = std::floor(area.position.y / m_cellSize) - 1;
+        long long y1 = std::floor((area.position.y + area.size.y) / m_cellSize) + 1;
+        auto append = [&] (const std::vector<Handle>& handles){
+            for(Handle h: handles){
+                out.push_back(m_slots[h].edge);
+            }
+        };
+        if((double)(x1 - x0 + 1) * (y1 - y0 + 1) > m_cells.size()){
+            // it is cheaper to check every cell
+            for(auto& cell: m_cells){
+                long long x = (std::int32_t)((unsigned long long)cell.first >> 32);
+                long long y = (std::int32_t)(cell.first & 0xffffffffLL);
+                if(x >= x0 && x <= x1 && y >= y0 && y <= y1){
+                    append(cell.second);
+                }
+            }
+        }else{
+            for(long long x = x0; x <= x1; x++){
+                for(long long y = y0; y <= y1; y++){
+                    auto it = m_cells.find(cellKey(x, y));
+                    if(it != m_cells.end()){
+                        append(it->second);
+                    }
+                }
+            }
+        }
+        for(Handle h: m_long){
+            if(m_slots[h].edge.getGlobalBounds().findIntersection(area)){
+                out.push_back(m_slots[h].edge);
+            }
+        }
+    }
+
+    void DynamicEdgeGrid::setScheduler(LightScheduler* scheduler){
+        m_scheduler = scheduler;
+    }
+
+    LightScheduler* DynamicEdgeGrid::getScheduler() const{
+        return m_scheduler;
+    }
+}
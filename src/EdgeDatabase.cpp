@@ -0,0 +1,405 @@
+#include "Candle/EdgeDatabase.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Candle/Constants.hpp"
+#include "Candle/Parallel.hpp"
+#include "Candle/Trace.hpp"
+#include "Candle/geometry/Vector2.hpp"
+
+namespace candle{
+    /*
+     * File layout (native byte order):
+     *   header: char[8] magic, uint32 version, float chunkSize, uint64 chunks
+     *   chunks: float origin.x, origin.y, scale, bounds (x, y, w, h),
+     *           uint32 edges, uint64 offset of the edges in the file
+     *   edges:  CompactEdge (4 x int16) of every chunk, contiguous
+     */
+    const char DATABASE_MAGIC[8] = { 'C', 'N', 'D', 'L', 'E', 'D', 'G', 'E' };
+    const std::uint32_t DATABASE_VERSION = 1;
+    const size_t HEADER_SIZE = 8 + 4 + 4 + 8;
+    const size_t CHUNK_RECORD_SIZE = 7 * 4 + 4 + 8;
+
+    struct EdgeDatabase::MappedFile{
+        const char* data = nullptr;
+        size_t size = 0;
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+
+        bool open(const std::string& path){
+            file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if(file == INVALID_HANDLE_VALUE){
+                return false;
+            }
+            LARGE_INTEGER fileSize;
+            if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0){
+                return false;
+            }
+            size = (size_t)fileSize.QuadPart;
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if(mapping == nullptr){
+                return false;
+            }
+            data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            return data != nullptr;
+        }
+
+        ~MappedFile(){
+            if(data != nullptr){
+                UnmapViewOfFile(data);
+            }
+            if(mapping != nullptr){
+                CloseHandle(mapping);
+            }
+            if(file != INVALID_HANDLE_VALUE){
+                CloseHandle(file);
+            }
+        }
+#else
+        int fd = -1;
+
+        bool open(const std::string& path){
+            fd = ::open(path.c_str(), O_RDONLY);
+            if(fd < 0){
+                return false;
+            }
+            struct stat st;
+            if(fstat(fd, &st) != 0 || st.st_size == 0){
+                return false;
+            }
+            size = (size_t)st.st_size;
+            void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            if(p == MAP_FAILED){
+                return false;
+            }
+            data = (const char*)p;
+            return true;
+        }
+
+        ~MappedFile(){
+            if(data != nullptr){
+                munmap((void*)data, size);
+            }
+            if(fd >= 0){
+                ::close(fd);
+            }
+        }
+#endif
+    };
+
+    template <typename T>
+    static void writeValue(std::ofstream& out, const T& value){
+        out.write((const char*)&value, sizeof(T));
+    }
+
+    template <typename T>
+    static T readValue(const char*& p){
+        T value;
+        std::memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return value;
+    }
+
+    bool EdgeDatabase::write(const std::string& path, const EdgeVector::const_iterator& begin,
+                             const EdgeVector::const_iterator& end, float chunkSize){
+        CANDLE_TRACE_ZONE("EdgeDatabase::write");
+        CompactEdgeVector compact(begin, end, chunkSize);
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if(!out){
+            return false;
+        }
+        const auto& chunks = compact.getChunks();
+        out.write(DATABASE_MAGIC, sizeof(DATABASE_MAGIC));
+        writeValue(out, DATABASE_VERSION);
+        writeValue(out, chunkSize);
+        writeValue(out, (std::uint64_t)chunks.size());
+        std::uint64_t offset = HEADER_SIZE + CHUNK_RECORD_SIZE * chunks.size();
+        for(auto& c: chunks){
+            writeValue(out, c.origin.x);
+            writeValue(out, c.origin.y);
+            writeValue(out, c.scale);
+            writeValue(out, c.bounds.position.x);
+            writeValue(out, c.bounds.position.y);
+            writeValue(out, c.bounds.size.x);
+            writeValue(out, c.bounds.size.y);
+            writeValue(out, (std::uint32_t)(c.end - c.begin));
+            writeValue(out, offset);
+            offset += (c.end - c.begin) * sizeof(CompactEdgeVector::CompactEdge);
+        }
+        for(auto& e: compact.getCompactEdges()){
+            writeValue(out, e.x1);
+            writeValue(out, e.y1);
+            writeValue(out, e.x2);
+            writeValue(out, e.y2);
+        }
+        return (bool)out;
+    }
+
+    EdgeDatabase::EdgeDatabase()
+        : m_chunkSize(0.f)
+        , m_cacheSize(64)
+        , m_hits(0)
+        , m_misses(0)
+        , m_hasCamera(false)
+        , m_lookAhead(30.f)
+        {}
+
+    EdgeDatabase::~EdgeDatabase(){
+        close();
+    }
+
+    bool EdgeDatabase::open(const std::string& path){
+        CANDLE_TRACE_ZONE("EdgeDatabase::open");
+        close();
+        std::unique_ptr<MappedFile> file(new MappedFile());
+        if(!file->open(path) || file->size < HEADER_SIZE
+            || std::memcmp(file->data, DATABASE_MAGIC, sizeof(DATABASE_MAGIC)) != 0){
+            return false;
+        }
+        const char* p = file->data + sizeof(DATABASE_MAGIC);
+        std::uint32_t version = readValue<std::uint32_t>(p);
+        float chunkSize = readValue<float>(p);
+        std::uint64_t count = readValue<std::uint64_t>(p);
+        if(version != DATABASE_VERSION || chunkSize <= 0.f
+            || count > (file->size - HEADER_SIZE) / CHUNK_RECORD_SIZE){
+            return false;
+        }
+        std::vector<ChunkEntry> chunks(count);
+        for(auto& entry: chunks){
+            auto& c = entry.chunk;
+            c.origin.x = readValue<float>(p);
+            c.origin.y = readValue<float>(p);
+            c.scale = readValue<float>(p);
+            c.bounds.position.x = readValue<float>(p);
+            c.bounds.position.y = readValue<float>(p);
+            c.bounds.size.x = readValue<float>(p);
+            c.bounds.size.y = readValue<float>(p);
+            c.begin = 0;
+            c.end = readValue<std::uint32_t>(p);
+            entry.offset = readValue<std::uint64_t>(p);
+            if(entry.offset + c.end * sizeof(CompactEdgeVector::CompactEdge) > file->size){
+                return false;
+            }
+        }
+        m_file = std::move(file);
+        m_chunkSize = chunkSize;
+        m_hits = m_misses = 0;
+        m_chunks.swap(chunks);
+        for(size_t i = 0; i < m_chunks.size(); i++){
+            const sf::FloatRect& b = m_chunks[i].chunk.bounds;
+            long long x0 = std::floor(b.position.x / m_chunkSize);
+            long long x1 = std::floor((b.position.x + b.size.x) / m_chunkSize);
+            long long y0 = std::floor(b.position.y / m_chunkSize);
+            long long y1 = std::floor((b.position.y + b.size.y) / m_chunkSize);
+            for(long long x = x0; x <= x1; x++){
+                for(long long y = y0; y <= y1; y++){
+                    m_grid[cellKey(x, y)].push_back(i);
+                }
+            }
+        }
+        return true;
+    }
+
+    void EdgeDatabase::close(){
+        if(m_prefetch.valid()){
+            m_prefetch.wait();
+        }
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+        m_cache.clear();
+        m_lru.clear();
+        m_grid.clear();
+        m_chunks.clear();
+        m_file.reset();
+        m_hasCamera = false;
+    }
+
+    bool EdgeDatabase::isOpen() const{
+        return m_file != nullptr;
+    }
+
+    size_t EdgeDatabase::getChunkCount() const{
+        return m_chunks.size();
+    }
+
+    float EdgeDatabase::getChunkSize() const{
+        return m_chunkSize;
+    }
+
+    std::vector<size_t> EdgeDatabase::chunksIn(const sf::FloatRect& area) const{
+        std::vector<size_t> ret;
+        if(!isOpen()){
+            return ret;
+        }
+        long long x0 = std::floor(area.position.x / m_chunkSize);
+        long long x1 = std::floor((area.position.x + area.size.x) / m_chunkSize);
+        long long y0 = std::floor(area.position.y / m_chunkSize);
+        long long y1 = std::floor((area.position.y + area.size.y) / m_chunkSize);
+        if((double)(x1 - x0 + 1) * (y1 - y0 + 1) > m_chunks.size()){
+            // it is cheaper to check every chunk
+            for(size_t i = 0; i < m_chunks.size(); i++){
+                ret.push_back(i);
+            }
+        }else{
+            for(long long x = x0; x <= x1; x++){
+                for(long long y = y0; y <= y1; y++){
+                    auto it = m_grid.find(cellKey(x, y));
+                    if(it != m_grid.end()){
+                        ret.insert(ret.end(), it->second.begin(), it->second.end());
+                    }
+                }
+            }
+            std::sort(ret.begin(), ret.end());
+            ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+        }
+        ret.erase(
+            std::remove_if(
+                ret.begin(),
+                ret.end(),
+                [&] (size_t c){ return !m_chunks[c].chunk.bounds.findIntersection(area); }
+            ),
+            ret.end()
+        );
+        return ret;
+    }
+
+    EdgeDatabase::ChunkEdges EdgeDatabase::decode(size_t chunk) const{
+        const ChunkEntry& entry = m_chunks[chunk];
+        auto edges = std::make_shared<EdgeVector>();
+        edges->reserve(entry.chunk.end);
+        const char* p = m_file->data + entry.offset;
+        for(size_t i = 0; i < entry.chunk.end; i++){
+            CompactEdgeVector::CompactEdge e;
+            e.x1 = readValue<std::int16_t>(p);
+            e.y1 = readValue<std::int16_t>(p);
+            e.x2 = readValue<std::int16_t>(p);
+            e.y2 = readValue<std::int16_t>(p);
+            edges->push_back(CompactEdgeVector::decode(entry.chunk, e));
+        }
+        return edges;
+    }
+
+    EdgeDatabase::ChunkEdges EdgeDatabase::load(size_t chunk, bool count){
+        {
+            std::lock_guard<std::mutex> lock(m_cacheMutex);
+            auto it = m_cache.find(chunk);
+            if(it != m_cache.end()){
+                m_lru.splice(m_lru.begin(), m_lru, it->second.position);
+                m_hits += count;
+                return it->second.edges;
+            }
+        }
+        // decode without holding the lock, so queries don't wait for the
+        // prefetch (and the other way round)
+        ChunkEdges edges = decode(chunk);
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+        m_misses += count;
+        auto it = m_cache.find(chunk);
+        if(it != m_cache.end()){
+            return it->second.edges;
+        }
+        m_lru.push_front(chunk);
+        m_cache[chunk] = { edges, m_lru.begin() };
+        while(m_cache.size() > m_cacheSize && !m_lru.empty()){
+            m_cache.erase(m_lru.back());
+            m_lru.pop_back();
+        }
+        return edges;
+    }
+
+    void EdgeDatabase::query(const sf::FloatRect& area, EdgeVector& out){
+        CANDLE_TRACE_ZONE("EdgeDatabase::query");
+        for(size_t c: chunksIn(area)){
+            ChunkEdges edges = load(c, true);
+            out.insert(out.end(), edges->begin(), edges->end());
+        }
+    }
+
+    void EdgeDatabase::prefetch(const sf::FloatRect& area, const sf::Vector2f& direction){
+        if(!isOpen()){
+            return;
+        }
+        if(m_prefetch.valid()
+            && m_prefetch.wait_for(std::chrono::seconds(0)) != std::future_status::ready){
+            return;
+        }
+        std::vector<size_t> chunks = chunksIn(area);
+        // the chunks needed first go first, in case they don't all fit
+        sf::Vector2f center = area.position + area.size / 2.f;
+        auto key = [&] (size_t c){
+            const sf::FloatRect& b = m_chunks[c].chunk.bounds;
+            sf::Vector2f d = b.position + b.size / 2.f - center;
+            return direction != sf::Vector2f() ? sfu::dot(d, direction) : sfu::magnitude2(d);
+        };
+        std::sort(chunks.begin(), chunks.end(), [&] (size_t a, size_t b){
+            return key(a) < key(b);
+        });
+        m_prefetch = runAsync([this, chunks] {
+            CANDLE_TRACE_ZONE("EdgeDatabase::prefetch");
+            // don't evict chunks that are being used to prefetch
+            size_t n = std::min(chunks.size(), getCacheSize() / 2);
+            for(size_t i = 0; i < n; i++){
+                load(chunks[i], false);
+            }
+        });
+    }
+
+    void EdgeDatabase::updateCamera(const sf::View& view){
+        sf::Vector2f center = view.getCenter();
+        if(m_hasCamera){
+            sf::Vector2f velocity = center - m_lastCamera;
+            if(velocity != sf::Vector2f()){
+                sf::FloatRect area = view.getInverseTransform().transformRect({ { -1.f, -1.f }, { 2.f, 2.f } });
+                area.position += velocity * m_lookAhead;
+                prefetch(area, velocity);
+            }
+        }
+        m_lastCamera = center;
+        m_hasCamera = true;
+    }
+
+    void EdgeDatabase::setLookAhead(float frames){
+        m_lookAhead = frames;
+    }
+
+    void EdgeDatabase::setCacheSize(size_t chunks){
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+        m_cacheSize = chunks;
+        while(m_cache.size() > m_cacheSize && !m_lru.empty()){
+            m_cache.erase(m_lru.back());
+            m_lru.pop_back();
+        }
+    }
+
+    size_t EdgeDatabase::getCacheSize() const{
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+        return m_cacheSize;
+    }
+
+    unsigned long EdgeDatabase::getCacheHits() const{
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+        return m_hits;
+    }
+
+    unsigned long EdgeDatabase::getCacheMisses() const{
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+        return m_misses;
+    }
+}
@@ -0,0 +1,247 @@
+#include "Candle/EdgeGrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "Candle/Parallel.hpp"
+#include "Candle/Trace.hpp"
+
+namespace candle{
+    const size_t EDGE_GRID_MAX_CELLS = 1 << 20;
+    // Minimum number of segments checked by each thread
+    const size_t PARALLEL_MIN_SEGMENTS = 256;
+    // Fraction of a cell under which the walk takes two crossings as a
+    // corner, and by which the grid is grown to clip the segments
+    const float EDGE_GRID_CORNER_EPSILON = 1e-4f;
+
+    // Intersection of two segments, excluding parallel ones
+    bool segmentsIntersect(const sfu::Line& a, const sfu::Line& b){
+        float d = a.m_direction.cross(b.m_direction);
+        if(d == 0.f){
+            return false;
+        }
+        sf::Vector2f o = b.m_origin - a.m_origin;
+        float t = o.cross(b.m_direction) / d;
+        float u = o.cross(a.m_direction) / d;
+        return t >= 0.f && t <= 1.f && u >= 0.f && u <= 1.f;
+    }
+
+    EdgeGrid::EdgeGrid(float cellSize)
+        : m_requestedCellSize(cellSize)
+        , m_cellSize(cellSize)
+        , m_width(0)
+        , m_height(0)
+        , m_threads(0)
+        {}
+
+    EdgeGrid::EdgeGrid(const EdgeVector::const_iterator& begin, const EdgeVector::const_iterator& end, float cellSize)
+        : EdgeGrid(cellSize)
+    {
+        assign(begin, end);
+    }
+
+    void EdgeGrid::assign(const EdgeVector::const_iterator& begin, const EdgeVector::const_iterator& end){
+        CANDLE_TRACE_ZONE("EdgeGrid::assign");
+        m_edges.assign(begin, end);
+        m_cellStart.clear();
+        m_cellEdges.clear();
+        m_width = m_height = 0;
+        m_cellSize = m_requestedCellSize;
+        if(m_edges.empty()){
+            return;
+        }
+        sf::Vector2f low = m_edges[0].m_origin, high = low;
+        for(auto& e: m_edges){
+            for(sf::Vector2f p: { e.m_origin, e.point(1.f) }){
+                low = { std::min(low.x, p.x), std::min(low.y, p.y) };
+                high = { std::max(high.x, p.x), std::max(high.y, p.y) };
+            }
+        }
+        m_origin = low;
+        sf::Vector2f size = high - low;
+        float cells = (size.x / m_cellSize + 1) * (size.y / m_cellSize + 1);
+        if(cells > EDGE_GRID_MAX_CELLS){
+            m_cellSize *= std::sqrt(cells / EDGE_GRID_MAX_CELLS);
+        }
+        m_width = std::floor(size.x / m_cellSize) + 1;
+        m_height = std::floor(size.y / m_cellSize) + 1;
+
+        // count the edges of every cell, then fill them in place
+        auto cellRange = [this] (const sfu::Line& e, unsigned int& x0, unsigned int& y0, unsigned int& x1, unsigned int& y1){
+            sf::Vector2f a = (e.m_origin - m_origin) / m_cellSize;
+            sf::Vector2f b = (e.point(1.f) - m_origin) / m_cellSize;
+            x0 = std::min<float>(std::min(a.x, b.x), m_width - 1);
+            y0 = std::min<float>(std::min(a.y, b.y), m_height - 1);
+            x1 = std::min<float>(std::max(a.x, b.x), m_width - 1);
+            y1 = std::min<float>(std::max(a.y, b.y), m_height - 1);
+        };
+        m_cellStart.assign(m_width * m_height + 1, 0);
+        for(auto& e: m_edges){
+            unsigned int x0, y0, x1, y1;
+            cellRange(e, x0, y0, x1, y1);
+            for(unsigned int y = y0; y <= y1; y++){
+                for(unsigned int x = x0; x <= x1; x++){
+                    m_cellStart[y * m_width + x + 1]++;
+                }
+            }
+        }
+        for(size_t i = 1; i < m_cellStart.size(); i++){
+            m_cellStart[i] += m_cellStart[i - 1];
+        }
+        m_cellEdges.resize(m_cellStart.back());
+        std::vector<std::uint32_t> fill(m_cellStart.begin(), m_cellStart.end() - 1);
+        for(std::uint32_t i = 0; i < m_edges.size(); i++){
+            unsigned int x0, y0, x1, y1;
+            cellRange(m_edges[i], x0, y0, x1, y1);
+            for(unsigned int y = y0; y <= y1; y++){
+                for(unsigned int x = x0; x <= x1; x++){
+                    m_cellEdges[fill[y * m_width + x]++] = i;
+                }
+            }
+        }
+    }
+
+    const EdgeVector& EdgeGrid::getEdges() const{
+        return m_edges;
+    }
+
+    float EdgeGrid::getCellSize() const{
+        return m_cellSize;
+    }
+
+    void EdgeGrid::query(const sf::FloatRect& area, EdgeVector& out) const{
+        if(m_width == 0){
+            return;
+        }
+        sf::Vector2f a = (area.position - m_origin) / m_cellSize;
+        sf::Vector2f b = a + area.size / m_cellSize;
+        if(b.x < 0.f || b.y < 0.f || a.x >= m_width || a.y >= m_height){
+            return;
+        }
+        unsigned int x0 = std::max(a.x, 0.f), y0 = std::max(a.y, 0.f);
+        unsigned int x1 = std::min<float>(b.x, m_width - 1), y1 = std::min<float>(b.y, m_height - 1);
+        std::vector<std::uint32_t> found;
+        for(unsigned int y = y0; y <= y1; y++){
+            for(unsigned int x = x0; x <= x1; x++){
+                unsigned int c = y * m_width + x;
+                found.insert(found.end(), m_cellEdges.begin() + m_cellStart[c], m_cellEdges.begin() + m_cellStart[c + 1]);
+            }
+        }
+        // the edges that cross several cells are found several times
+        std::sort(found.begin(), found.end());
+        found.erase(std::unique(found.begin(), found.end()), found.end());
+        for(std::uint32_t i: found){
+            out.push_back(m_edges[i]);
+        }
+    }
+
+    template <typename F>
+    bool EdgeGrid::walk(const sfu::Line& segment, F f) const{
+        if(m_width == 0){
+            return false;
+        }
+        // clip the segment to the grid, a bit bigger so that the segments
+        // that graze its sides aren't lost to rounding
+        sf::Vector2f o = (segment.m_origin - m_origin) / m_cellSize;
+        sf::Vector2f d = segment.m_direction / m_cellSize;
+        float t0 = 0.f, t1 = 1.f;
+        const float e = EDGE_GRID_CORNER_EPSILON;
+        const float bounds[2][2] = { { -e, m_width + e }, { -e, m_height + e } };
+        for(int axis = 0; axis < 2; axis++){
+            float oa = axis == 0 ? o.x : o.y;
+            float da = axis == 0 ? d.x : d.y;
+            if(da == 0.f){
+                if(oa < bounds[axis][0] || oa > bounds[axis][1]){
+                    return false;
+                }
+                continue;
+            }
+            float ta = (bounds[axis][0] - oa) / da;
+            float tb = (bounds[axis][1] - oa) / da;
+            t0 = std::max(t0, std::min(ta, tb));
+            t1 = std::min(t1, std::max(ta, tb));
+        }
+        if(t0 > t1){
+            return false;
+        }
+        // walk the cells crossed by the segment, in order
+        sf::Vector2f p = o + t0 * d;
+        int x = std::min<int>(std::max(0.f, std::floor(p.x)), m_width - 1);
+        int y = std::min<int>(std::max(0.f, std::floor(p.y)), m_height - 1);
+        int stepX = d.x > 0.f ? 1 : -1;
+        int stepY = d.y > 0.f ? 1 : -1;
+        const float inf = std::numeric_limits<float>::infinity();
+        float deltaX = d.x != 0.f ? std::abs(1.f / d.x) : inf;
+        float deltaY = d.y != 0.f ? std::abs(1.f / d.y) : inf;
+        float nextX = d.x != 0.f ? (x + (stepX > 0) - o.x) / d.x : inf;
+        float nextY = d.y != 0.f ? (y + (stepY > 0) - o.y) / d.y : inf;
+        float epsilon = EDGE_GRID_CORNER_EPSILON * std::min(deltaX, deltaY);
+        auto visit = [&] (int cx, int cy){
+            if(cx < 0 || cy < 0 || cx >= (int)m_width || cy >= (int)m_height){
+                return false;
+            }
+            unsigned int c = cy * m_width + cx;
+            for(std::uint32_t i = m_cellStart[c]; i < m_cellStart[c + 1]; i++){
+                if(f(m_edges[m_cellEdges[i]])){
+                    return true;
+                }
+            }
+            return false;
+        };
+        while(true){
+            if(visit(x, y)){
+                return true;
+            }
+            if(std::min(nextX, nextY) > t1 + epsilon){
+                return false;
+            }
+            // the edges that touch a corner may only be in the cell at its
+            // bottom right, so through a corner both cells beside the
+            // diagonal are visited
+            bool corner = std::abs(nextX - nextY) <= epsilon;
+            if(nextX < nextY){
+                if(corner && visit(x, y + stepY)){
+                    return true;
+                }
+                x += stepX;
+                nextX += deltaX;
+            }else{
+                if(corner && visit(x + stepX, y)){
+                    return true;
+                }
+                y += stepY;
+                nextY += deltaY;
+            }
+            if(x < 0 || y < 0 || x >= (int)m_width || y >= (int)m_height){
+                return false;
+            }
+        }
+    }
+
+    bool EdgeGrid::intersects(const sfu::Line& segment) const{
+        return walk(segment, [&segment] (const sfu::Line& edge){
+            return segmentsIntersect(segment, edge);
+        });
+    }
+
+    void EdgeGrid::intersects(const std::vector<sfu::Line>& segments, std::vector<char>& blocked) const{
+        CANDLE_TRACE_ZONE("EdgeGrid::intersects");
+        blocked.resize(segments.size());
+        parallelFor(segments.size(), m_threads, PARALLEL_MIN_SEGMENTS,
+            [&] (size_t b, size_t e, unsigned int){
+                for(size_t i = b; i < e; i++){
+                    blocked[i] = intersects(segments[i]);
+                }
+            }
+        );
+    }
+
+    void EdgeGrid::setThreadCount(unsigned int threads){
+        m_threads = threads;
+    }
+
+    unsigned int EdgeGrid::getThreadCount() const{
+        return m_threads;
+    }
+}
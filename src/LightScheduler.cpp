@@ -0,0 +1,187 @@
+#include "Candle/LightScheduler.hpp"
+
+#include <algorithm>
+
+#include "Candle/DynamicEdgeGrid.hpp"
+#include "Candle/geometry/Vector2.hpp"
+#include "Candle/Trace.hpp"
+
+namespace candle{
+    LightScheduler::LightScheduler()
+        : m_timeBudget(sf::milliseconds(4))
+        , m_rayBudget(0)
+        , m_staleWeight(0.5f)
+        {}
+
+    LightScheduler::Entry* LightScheduler::find(const LightSource* light){
+        for(auto& e: m_entries){
+            if(e.light == light){
+                return &e;
+            }
+        }
+        return nullptr;
+    }
+
+    const LightScheduler::Entry* LightScheduler::find(const LightSource* light) const{
+        for(auto& e: m_entries){
+            if(e.light == light){
+                return &e;
+            }
+        }
+        return nullptr;
+    }
+
+    void LightScheduler::addLight(LightSource* light){
+        if(find(light) == nullptr){
+            m_entries.push_back({ light, true, 0, light->getTransform(), light->getRange() });
+        }
+    }
+
+    void LightScheduler::removeLight(const LightSource* light){
+        m_entries.erase(
+            std::remove_if(
+                m_entries.begin(),
+                m_entries.end(),
+                [light] (const Entry& e){ return e.light == light; }
+            ),
+            m_entries.end()
+        );
+    }
+
+    void LightScheduler::clear(){
+        m_entries.clear();
+    }
+
+    size_t LightScheduler::getLightCount() const{
+        return m_entries.size();
+    }
+
+    size_t LightScheduler::getDirtyCount() const{
+        return std::count_if(
+            m_entries.begin(),
+            m_entries.end(),
+            [] (const Entry& e){ return e.dirty; }
+        );
+    }
+
+    void LightScheduler::markDirty(const LightSource* light){
+        Entry* e = find(light);
+        if(e != nullptr){
+            e->dirty = true;
+        }
+    }
+
+    void LightScheduler::markDirty(const sf::FloatRect& area){
+        for(auto& e: m_entries){
+            if(e.light->getGlobalBounds().findIntersection(area)){
+                e.dirty = true;
+            }
+        }
+    }
+
+    void LightScheduler::markAllDirty(){
+        for(auto& e: m_entries){
+            e.dirty = true;
+        }
+    }
+
+    bool LightScheduler::isDirty(const LightSource* light) const{
+        const Entry* e = find(light);
+        return e != nullptr && e->dirty;
+    }
+
+    void LightScheduler::setTimeBudget(sf::Time budget){
+        m_timeBudget = budget;
+    }
+
+    sf::Time LightScheduler::getTimeBudget() const{
+        return m_timeBudget;
+    }
+
+    void LightScheduler::setRayBudget(unsigned long budget){
+        m_rayBudget = budget;
+    }
+
+    unsigned long LightScheduler::getRayBudget() const{
+        return m_rayBudget;
+    }
+
+    void LightScheduler::setStaleWeight(float weight){
+        m_staleWeight = weight;
+    }
+
+    unsigned int LightScheduler::update(const EdgeVector::iterator& begin, const EdgeVector::iterator& end, const sf::View& view){
+        return schedule(view, [&] (LightSource& light){ light.castLight(begin, end); });
+    }
+
+    unsigned int LightScheduler::update(const DynamicEdgeGrid& edges, const sf::View& view){
+        return schedule(view, [&] (LightSource& light){ light.castLight(edges); });
+    }
+
+    unsigned int LightScheduler::schedule(const sf::View& view, const std::function<void(LightSource&)>& cast){
+        CANDLE_TRACE_ZONE("LightScheduler::update");
+        sf::Clock clock;
+        sf::FloatRect viewBounds = view.getInverseTransform().transformRect({ { -1.f, -1.f }, { 2.f, 2.f } });
+        float viewArea = viewBounds.size.x * viewBounds.size.y;
+        float viewDiagonal = sfu::magnitude(viewBounds.size);
+        sf::Vector2f viewCenter = viewBounds.position + viewBounds.size / 2.f;
+
+        // the lights that moved since their last cast are dirty too
+        std::vector<std::pair<float, Entry*>> queue;
+        for(auto& e: m_entries){
+            sf::Transform trm = e.light->getTransform();
+            float range = e.light->getRange();
+            if(trm != e.transform || range != e.range){
+                e.transform = trm;
+                e.range = range;
+                e.dirty = true;
+            }
+            if(!e.dirty){
+                continue;
+            }
+            sf::FloatRect bounds = e.light->getGlobalBounds();
+            auto visible = bounds.findIntersection(viewBounds);
+            if(!visible){
+                continue;
+            }
+            // small lights still get older, so they get their turn
+            float coverage = visible->size.x * visible->size.y / viewArea + 1e-4f;
+            float distance = sfu::magnitude(bounds.position + bounds.size / 2.f - viewCenter) / viewDiagonal;
+            float priority = coverage * (1.f + e.staleFrames * m_staleWeight) / (1.f + distance);
+            queue.emplace_back(priority, &e);
+        }
+        std::sort(
+            queue.begin(),
+            queue.end(),
+            [] (const std::pair<float, Entry*>& a, const std::pair<float, Entry*>& b){
+                return a.first > b.first;
+            }
+        );
+
+        unsigned int casted = 0;
+        unsigned long rays = 0;
+        for(auto& q: queue){
+            Entry& e = *q.second;
+            unsigned long estimate = e.light->getVertexCount();
+            if(casted > 0){
+                if(m_timeBudget > sf::Time::Zero && clock.getElapsedTime() >= m_timeBudget){
+                    break;
+                }
+                if(m_rayBudget > 0 && rays + estimate > m_rayBudget){
+                    break;
+                }
+            }
+            cast(*e.light);
+            e.dirty = false;
+            e.staleFrames = 0;
+            rays += e.light->getVertexCount();
+            casted++;
+        }
+        for(auto& e: m_entries){
+            if(e.dirty){
+                e.staleFrames++;
+            }
+        }
+        return casted;
+    }
+}
@@ -1,24 +1,149 @@
 #include "Candle/LightSource.hpp"
 
 #include <algorithm>
+#include <cmath>
+#include <memory>
 
+#include "Candle/CompactEdgeVector.hpp"
 #include "Candle/Constants.hpp"
+#include "Candle/DynamicEdgeGrid.hpp"
+#include "Candle/EdgeDatabase.hpp"
+#include "Candle/EdgeGrid.hpp"
 #include "Candle/geometry/Line.hpp"
 #include "Candle/geometry/Vector2.hpp"
 #include "Candle/graphics/VertexArray.hpp"
+#include "Candle/Parallel.hpp"
+#include "Candle/Trace.hpp"
 
 namespace candle{
+    // The color of the light is applied by the shader, so the vertices only
+    // carry the fade
+    const char* TINT_SHADER =
+        "uniform vec4 tint;"
+        "void main(){"
+        "    gl_FragColor = gl_Color * tint;"
+        "}";
+    const char* TINT_TEXTURE_SHADER =
+        "uniform sampler2D texture;"
+        "uniform vec4 tint;"
+        "void main(){"
+        "    gl_FragColor = gl_Color * texture2D(texture, gl_TexCoord[0].xy) * tint;"
+        "}";
+    // Sides of the polygons that replace the circles for the lights that
+    // can't intersect them
+    const unsigned int CIRCLE_EDGES = 16;
+    bool l_shadersReady(false);
+    std::unique_ptr<sf::Shader> l_tintShader;
+    std::unique_ptr<sf::Shader> l_tintTextureShader;
+    unsigned int l_animationSeed(0);
+
+    void initializeShaders(){
+        CANDLE_TRACE_ZONE("initializeShaders");
+        l_shadersReady = true;
+        if(!sf::Shader::isAvailable()){
+            return;
+        }
+        l_tintShader.reset(new sf::Shader);
+        l_tintTextureShader.reset(new sf::Shader);
+        if(!l_tintShader->loadFromMemory(TINT_SHADER, sf::Shader::Type::Fragment)
+            || !l_tintTextureShader->loadFromMemory(TINT_TEXTURE_SHADER, sf::Shader::Type::Fragment)){
+            l_tintShader.reset(nullptr);
+            l_tintTextureShader.reset(nullptr);
+            return;
+        }
+        l_tintTextureShader->setUniform("texture", sf::Shader::CurrentTexture);
+    }
+
+    // Pseudo-random value in [0, 1] for each integer
+    float animationNoise(unsigned int n){
+        n = (n << 13) ^ n;
+        n = n * (n * n * 15731u + 789221u) + 1376312589u;
+        return (n & 0x7fffffffu) / float(0x7fffffff);
+    }
+
+    PolygonView::const_iterator::const_iterator(const PolygonView* view, size_t index)
+        : m_view(view)
+        , m_index(index)
+        {}
+    
+    sf::Vector2f PolygonView::const_iterator::operator*() const{
+        return (*m_view)[m_index];
+    }
+    
+    PolygonView::const_iterator& PolygonView::const_iterator::operator++(){
+        m_index++;
+        return *this;
+    }
+    
+    PolygonView::const_iterator PolygonView::const_iterator::operator++(int){
+        const_iterator copy = *this;
+        m_index++;
+        return copy;
+    }
+    
+    bool PolygonView::const_iterator::operator==(const const_iterator& other) const{
+        return m_view == other.m_view && m_index == other.m_index;
+    }
+    
+    bool PolygonView::const_iterator::operator!=(const const_iterator& other) const{
+        return !(*this == other);
+    }
+    
+    PolygonView::PolygonView(const sf::VertexArray& polygon, const sf::Transform& transform)
+        : m_polygon(&polygon)
+        , m_transform(transform)
+        {}
+    
+    size_t PolygonView::size() const{
+        return m_polygon->getVertexCount();
+    }
+    
+    sf::Vector2f PolygonView::operator[](size_t index) const{
+        return m_transform.transformPoint((*m_polygon)[index].position);
+    }
+    
+    sf::PrimitiveType PolygonView::getPrimitiveType() const{
+        return m_polygon->getPrimitiveType();
+    }
+    
+    const sf::VertexArray& PolygonView::getVertices() const{
+        return *m_polygon;
+    }
+    
+    const sf::Transform& PolygonView::getTransform() const{
+        return m_transform;
+    }
+    
+    sf::FloatRect PolygonView::getBounds() const{
+        return m_transform.transformRect(m_polygon->getBounds());
+    }
+    
+    PolygonView::const_iterator PolygonView::begin() const{
+        return const_iterator(this, 0);
+    }
+    
+    PolygonView::const_iterator PolygonView::end() const{
+        return const_iterator(this, size());
+    }
+    
     LightSource::LightSource()
-        : m_color(sf::Color::White)
+        : m_animation(STEADY)
+        , m_animationPeriod(1.f)
+        , m_animationAmplitude(0.f)
+        , m_animationSeed(l_animationSeed++ * 7919u)
+        , m_storage(VERTEX_ARRAY)
+        , m_static(false)
+        , m_shaderTint(false)
+        , m_color(sf::Color::White)
         , m_fade(true)
 #ifdef CANDLE_DEBUG
         , m_debug(sf::Lines, 0)
 #endif
+        , m_geometryVersion(1)
         {}
     
     void LightSource::setIntensity(float intensity){
         m_color.a = 255 * intensity;
-        resetColor();
     }
     
     float LightSource::getIntensity() const{
@@ -27,7 +152,6 @@ namespace candle{
     
     void LightSource::setColor(const sf::Color& c){
         m_color = {c.r, c.g, c.b, m_color.a};
-        resetColor();
     }
     
     sf::Color LightSource::getColor() const{
@@ -35,9 +159,138 @@ namespace candle{
         return {c.r, c.g, c.b, 255};
     }
     
+    void LightSource::setAnimation(Animation animation, float period, float amplitude){
+        m_animation = animation;
+        m_animationPeriod = period;
+        m_animationAmplitude = std::min(std::max(amplitude, 0.f), 1.f);
+        m_animationClock.restart();
+    }
+    
+    LightSource::Animation LightSource::getAnimation() const{
+        return m_animation;
+    }
+    
+    void LightSource::restartAnimation(){
+        m_animationClock.restart();
+    }
+    
+    float LightSource::getAnimatedIntensity() const{
+        float factor = 1.f;
+        float t = m_animationPeriod > 0.f
+            ? m_animationClock.getElapsedTime().asSeconds() / m_animationPeriod
+            : 1.f;
+        switch(m_animation){
+            case FLICKER: {
+                float step = std::floor(t);
+                float f = t - step;
+                f = f * f * (3.f - 2.f * f); // smoothstep
+                unsigned int n = m_animationSeed + unsigned(step);
+                float v = animationNoise(n) + (animationNoise(n + 1) - animationNoise(n)) * f;
+                factor = 1.f - m_animationAmplitude * v;
+                break;
+            }
+            case PULSE:
+                factor = 1.f - m_animationAmplitude * (0.5f - 0.5f * std::cos(2.f * sfu::PI * t));
+                break;
+            case FADE_IN:
+                factor = std::min(t, 1.f);
+                break;
+            case FADE_OUT:
+                factor = std::max(1.f - t, 0.f);
+                break;
+            default:
+                break;
+        }
+        return getIntensity() * factor;
+    }
+    
+    sf::Color LightSource::getTint() const{
+        sf::Color tint = m_color;
+        tint.a = 255 * getAnimatedIntensity();
+        return tint;
+    }
+    
+    void LightSource::drawGeometry(sf::RenderTarget& t, sf::RenderStates st, const sf::VertexArray& geometry, GeometryCache& cache) const{
+        if(!l_shadersReady){
+            initializeShaders();
+        }
+        sf::Color tint = getTint();
+        const sf::VertexArray* vertices = &geometry;
+        if(st.shader != nullptr && m_shaderTint){
+            // the shader of the caller applies the tint itself
+            tint = sf::Color::White;
+        }else if(st.shader == nullptr && l_tintShader){
+            sf::Shader* shader = st.texture != nullptr ? l_tintTextureShader.get() : l_tintShader.get();
+            shader->setUniform("tint", sf::Glsl::Vec4(tint));
+            st.shader = shader;
+            // the vertices are drawn as they are
+            tint = sf::Color::White;
+        }else{
+            if(cache.version != m_geometryVersion || cache.tint != tint){
+                CANDLE_TRACE_ZONE("LightSource::tintGeometry");
+                cache.vertices = geometry;
+                for(size_t i = 0; i < cache.vertices.getVertexCount(); i++){
+                    cache.vertices[i].color *= tint;
+                }
+                cache.tint = tint;
+                cache.version = m_geometryVersion;
+            }
+            vertices = &cache.vertices;
+        }
+        size_t count = vertices->getVertexCount();
+        if(m_storage == VERTEX_ARRAY || count == 0 || !sf::VertexBuffer::isAvailable()){
+            t.draw(*vertices, st);
+            return;
+        }
+        sf::VertexBuffer::Usage usage = m_storage == STATIC_BUFFER
+            ? sf::VertexBuffer::Usage::Static
+            : sf::VertexBuffer::Usage::Dynamic;
+        if(cache.bufferVersion != m_geometryVersion || cache.bufferTint != tint
+            || cache.buffer.getUsage() != usage){
+            CANDLE_TRACE_ZONE("LightSource::uploadGeometry");
+            cache.buffer.setPrimitiveType(vertices->getPrimitiveType());
+            cache.buffer.setUsage(usage);
+            bool uploaded = (cache.buffer.getVertexCount() == count || cache.buffer.create(count))
+                && cache.buffer.update(&(*vertices)[0]);
+            if(!uploaded){
+                cache.bufferVersion = 0;
+                t.draw(*vertices, st);
+                return;
+            }
+            cache.bufferTint = tint;
+            cache.bufferVersion = m_geometryVersion;
+        }
+        t.draw(cache.buffer, st);
+    }
+    
+    void LightSource::setGeometryStorage(GeometryStorage storage){
+        m_storage = storage;
+    }
+    
+    LightSource::GeometryStorage LightSource::getGeometryStorage() const{
+        return m_storage;
+    }
+    
+    void LightSource::setStatic(bool isStatic){
+        m_static = isStatic;
+    }
+    
+    bool LightSource::isStatic() const{
+        return m_static;
+    }
+    
+    void LightSource::setShaderTint(bool shaderTint){
+        m_shaderTint = shaderTint;
+    }
+    
+    bool LightSource::getShaderTint() const{
+        return m_shaderTint;
+    }
+    
     void LightSource::setFade(bool fade){
         m_fade = fade;
         resetColor();
+        m_geometryVersion++;
     }
     
     bool LightSource::getFade() const{
@@ -52,4 +305,129 @@ namespace candle{
         return m_range;
     }
     
+    sf::Transform LightSource::getPolygonTransform() const{
+        return Transformable::getTransform();
+    }
+    
+    void LightSource::swapGeometry(LightSource& other){
+        std::swap(m_polygon, other.m_polygon);
+        m_geometryVersion++;
+        other.m_geometryVersion++;
+#ifdef CANDLE_DEBUG
+        std::swap(m_debug, other.m_debug);
+#endif
+    }
+    
+    sf::Transform LightSource::getDrawTransform() const{
+        return m_castTransform ? *m_castTransform : getPolygonTransform();
+    }
+    
+    void LightSource::castLight(const EdgeVector::iterator& begin, const EdgeVector::iterator& end,
+                                const CircleVector::const_iterator& circlesBegin,
+                                const CircleVector::const_iterator& circlesEnd){
+        EdgeVector edges(begin, end);
+        for(auto it = circlesBegin; it != circlesEnd; it++){
+            it->polygonize(edges, CIRCLE_EDGES);
+        }
+        castLight(edges.begin(), edges.end());
+    }
+    
+    void LightSource::castLight(const CompactEdgeVector::const_iterator& begin,
+                                const CompactEdgeVector::const_iterator& end){
+        EdgeVector decoded(begin, end);
+        castLight(decoded.begin(), decoded.end());
+    }
+    
+    void LightSource::castLight(const CompactEdgeVector& edges){
+        castLight(edges.begin(getGlobalBounds()), edges.end());
+    }
+    
+    void LightSource::castLight(EdgeDatabase& edges){
+        EdgeVector queried;
+        edges.query(getGlobalBounds(), queried);
+        castLight(queried.begin(), queried.end());
+    }
+    
+    void LightSource::castLight(const EdgeGrid& edges){
+        EdgeVector queried;
+        edges.query(getGlobalBounds(), queried);
+        castLight(queried.begin(), queried.end());
+    }
+    
+    void LightSource::castLight(const DynamicEdgeGrid& edges){
+        EdgeVector queried;
+        edges.query(getGlobalBounds(), queried);
+        castLight(queried.begin(), queried.end());
+    }
+    
+    void LightSource::castLightAsync(const EdgeVector::iterator& begin, const EdgeVector::iterator& end){
+        if(m_async.result.valid()){
+            m_async.result.wait();
+        }
+        std::unique_ptr<LightSource> snapshot = clone();
+        snapshot->m_polygon.clear();
+        snapshot->resetCastStatistics();
+        m_async.result = runAsync(
+            [begin, end, light = std::move(snapshot)] () mutable {
+                CANDLE_TRACE_ZONE("LightSource::castLightAsync");
+                light->castLight(begin, end);
+                return std::move(light);
+            }
+        );
+    }
+    
+    bool LightSource::swapBuffers(){
+        if(!m_async.result.valid()){
+            return false;
+        }
+        CANDLE_TRACE_ZONE("LightSource::swapBuffers");
+        std::unique_ptr<LightSource> snapshot = m_async.result.get();
+        swapGeometry(*snapshot);
+#ifdef CANDLE_STATISTICS
+        m_stats += snapshot->m_stats;
+#endif
+        m_castTransform = snapshot->getPolygonTransform();
+        // the fade may have changed since the snapshot
+        resetColor();
+        m_geometryVersion++;
+        return true;
+    }
+    
+    bool LightSource::isCastPending() const{
+        return m_async.result.valid();
+    }
+    
+    size_t LightSource::getVertexCount() const{
+        return m_polygon.getVertexCount();
+    }
+    
+    const sf::VertexArray& LightSource::getPolygon() const{
+        return m_polygon;
+    }
+    
+    PolygonView LightSource::getGlobalPolygon() const{
+        return PolygonView(m_polygon, getDrawTransform());
+    }
+    
+    bool LightSource::isVisible(const sf::View& view, const sf::Transform& transform) const{
+        sf::FloatRect viewBounds = view.getInverseTransform().transformRect({ { -1.f, -1.f }, { 2.f, 2.f } });
+        sf::FloatRect lightBounds = transform.transformRect(getGlobalBounds());
+        return lightBounds.findIntersection(viewBounds).has_value();
+    }
+    
+    const CastStatistics& LightSource::getCastStatistics() const{
+#ifdef CANDLE_STATISTICS
+        return m_stats;
+#else
+        static const CastStatistics empty;
+        return empty;
+#endif
+    }
+    
+    void LightSource::resetCastStatistics(){
+#ifdef CANDLE_STATISTICS
+        m_stats.reset();
+#endif
+    }
+    
 }
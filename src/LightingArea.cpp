@@ -1,5 +1,10 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
 #include "Candle/LightingArea.hpp"
 #include "Candle/graphics/VertexArray.hpp"
+#include "Candle/Trace.hpp"
 
 
 namespace candle{
@@ -12,7 +17,63 @@ namespace candle{
         sf::BlendMode::Factor::OneMinusSrcAlpha,  // alpha dst
         sf::BlendMode::Equation::Add    );            // alpha eq
     
+    // Samples at each side of the center of the gaussian, at most
+    const int BLUR_MAX_TAPS = 16;
+    // One pass of a separable gaussian, along the step
+    const char* BLUR_SHADER =
+        "uniform sampler2D texture;"
+        "uniform vec2 step;"
+        "uniform float weights[17];"
+        "uniform int taps;"
+        "void main(){"
+        "    vec2 uv = gl_TexCoord[0].xy;"
+        "    vec4 sum = texture2D(texture, uv) * weights[0];"
+        "    for(int i = 1; i < 17; i++){"
+        "        if(i > taps) break;"
+        "        vec2 d = step * float(i);"
+        "        sum += (texture2D(texture, uv + d) + texture2D(texture, uv - d)) * weights[i];"
+        "    }"
+        "    gl_FragColor = sum;"
+        "}";
+    bool l_blurReady(false);
+    std::unique_ptr<sf::Shader> l_blurShader;
+    
+    void initializeBlurShader(){
+        CANDLE_TRACE_ZONE("initializeBlurShader");
+        l_blurReady = true;
+        if(!sf::Shader::isAvailable()){
+            return;
+        }
+        l_blurShader.reset(new sf::Shader);
+        if(!l_blurShader->loadFromMemory(BLUR_SHADER, sf::Shader::Type::Fragment)){
+            l_blurShader.reset(nullptr);
+            return;
+        }
+        l_blurShader->setUniform("texture", sf::Shader::CurrentTexture);
+    }
+    
+    // Draw a whole texture over a whole render texture, replacing it
+    void blit(const sf::Texture& source, sf::RenderTexture& target, const sf::Shader* shader){
+        sf::Vector2f from(source.getSize()), to(target.getSize());
+        sf::VertexArray quad(sf::PrimitiveType::TriangleStrip, 4);
+        quad[0].position = {0, 0};
+        quad[1].position = {0, to.y};
+        quad[2].position = {to.x, 0};
+        quad[3].position = to;
+        quad[0].texCoords = {0, 0};
+        quad[1].texCoords = {0, from.y};
+        quad[2].texCoords = {from.x, 0};
+        quad[3].texCoords = from;
+        sf::RenderStates rs;
+        rs.blendMode = sf::BlendNone;
+        rs.texture = &source;
+        rs.shader = shader;
+        target.draw(quad, rs);
+        target.display();
+    }
+    
     void LightingArea::initializeRenderTexture(const sf::Vector2f& size){
+        CANDLE_TRACE_ZONE("LightingArea::initializeRenderTexture");
         m_renderTexture.resize(sf::Vector2u(size));
         m_renderTexture.setSmooth(true);
         m_baseTextureQuad[0].position =
@@ -33,6 +94,9 @@ namespace candle{
     : m_baseTextureQuad(sf::PrimitiveType::TriangleStrip, 4)
     , m_areaQuad(sf::PrimitiveType::TriangleStrip, 4)
     , m_color(sf::Color::White)
+    , m_hasLightmap(false)
+    , m_blurRadius(0.f)
+    , m_blurDownsampling(4)
     {
         m_opacity = 1.f;
         m_mode = mode;
@@ -45,6 +109,9 @@ namespace candle{
     : m_baseTextureQuad(sf::PrimitiveType::TriangleStrip, 4)
     , m_areaQuad(sf::PrimitiveType::TriangleStrip, 4)
     , m_color(sf::Color::White)
+    , m_hasLightmap(false)
+    , m_blurRadius(0.f)
+    , m_blurDownsampling(4)
     {
         m_opacity = 1.f;
         m_mode = mode;
@@ -71,7 +138,13 @@ namespace candle{
     }
     
     void LightingArea::clear(){
-        if(m_baseTexture != nullptr){
+        CANDLE_TRACE_ZONE("LightingArea::clear");
+        if(m_hasLightmap){
+            sf::RenderStates rs;
+            rs.blendMode = sf::BlendNone;
+            rs.texture = &m_lightmap;
+            m_renderTexture.draw(m_areaQuad, rs);
+        }else if(m_baseTexture != nullptr){
             m_renderTexture.clear(sf::Color::Transparent);
             m_renderTexture.draw(m_baseTextureQuad, m_baseTexture);
         }else{
@@ -104,7 +177,10 @@ namespace candle{
     }
     
     void LightingArea::draw(const LightSource& light){
-        if(m_opacity > 0.f && m_mode == FOG){
+        CANDLE_TRACE_ZONE("LightingArea::draw");
+        if(m_opacity > 0.f && m_mode == FOG
+            && !(m_hasLightmap && light.isStatic())
+            && light.getGlobalBounds().findIntersection(getGlobalBounds())){
             sf::RenderStates fogrs;
             fogrs.blendMode = l_substractAlpha;
             fogrs.transform *= Transformable::getTransform().getInverse();
@@ -144,7 +220,135 @@ namespace candle{
         return m_mode;
     }
     
+    void LightingArea::bake(const std::vector<const LightSource*>& lights){
+        CANDLE_TRACE_ZONE("LightingArea::bake");
+        m_hasLightmap = false;
+        clear();
+        sf::RenderStates rs;
+        if(m_mode == FOG){
+            rs.blendMode = l_substractAlpha;
+        }
+        rs.transform *= Transformable::getTransform().getInverse();
+        for(const LightSource* light: lights){
+            if(light->isStatic() && light->getGlobalBounds().findIntersection(getGlobalBounds())){
+                m_renderTexture.draw(*light, rs);
+            }
+        }
+        m_renderTexture.display();
+        m_lightmap = m_renderTexture.getTexture();
+        m_hasLightmap = true;
+    }
+    
+    bool LightingArea::hasLightmap() const{
+        return m_hasLightmap;
+    }
+    
+    void LightingArea::clearLightmap(){
+        m_hasLightmap = false;
+    }
+    
+    bool LightingArea::saveLightmap(const std::string& path) const{
+        return m_hasLightmap && m_lightmap.copyToImage().saveToFile(path);
+    }
+    
+    bool LightingArea::loadLightmap(const std::string& path){
+        sf::Texture lightmap;
+        if(!lightmap.loadFromFile(path) || lightmap.getSize() != m_renderTexture.getSize()){
+            return false;
+        }
+        lightmap.setSmooth(true);
+        m_lightmap = std::move(lightmap);
+        m_hasLightmap = true;
+        return true;
+    }
+    
+    void LightingArea::setBlurRadius(float radius){
+        m_blurRadius = std::max(0.f, radius);
+    }
+    
+    float LightingArea::getBlurRadius() const{
+        return m_blurRadius;
+    }
+    
+    void LightingArea::setBlurDownsampling(unsigned int factor){
+        m_blurDownsampling = std::max(1u, factor);
+    }
+    
+    unsigned int LightingArea::getBlurDownsampling() const{
+        return m_blurDownsampling;
+    }
+    
+    void LightingArea::blur(){
+        CANDLE_TRACE_ZONE("LightingArea::blur");
+        if(!l_blurReady){
+            initializeBlurShader();
+        }
+        unsigned int factor = std::max<unsigned int>(m_blurDownsampling, std::ceil(m_blurRadius / BLUR_MAX_TAPS));
+        // Downsample by halving: a bilinear fetch at the corner of 2x2
+        // pixels is their average, so every halving is a box filter and the
+        // whole chain averages every pixel of the area
+        unsigned int halvings = 0;
+        while((1u << halvings) < factor){
+            halvings++;
+        }
+        factor = 1u << halvings;
+        auto prepare = [] (sf::RenderTexture& rt, const sf::Vector2u& size){
+            if(rt.getSize() != size){
+                if(!rt.resize(size)){
+                    return false;
+                }
+                rt.setSmooth(true);
+            }
+            return true;
+        };
+        sf::Vector2u low = m_renderTexture.getSize();
+        m_blurChain.resize(std::max(halvings, 1u) - 1);
+        for(unsigned int i = 0; i < halvings; i++){
+            low = { (low.x + 1) / 2, (low.y + 1) / 2 };
+            if(i < m_blurChain.size() && !prepare(m_blurChain[i], low)){
+                return;
+            }
+        }
+        for(auto& rt: m_blurTextures){
+            if(!prepare(rt, low)){
+                return;
+            }
+        }
+        const sf::Texture* source = &m_renderTexture.getTexture();
+        for(auto& rt: m_blurChain){
+            blit(*source, rt, nullptr);
+            source = &rt.getTexture();
+        }
+        blit(*source, m_blurTextures[0], nullptr);
+        if(l_blurShader){
+            // gaussian with the radius at two standard deviations
+            float radius = m_blurRadius / factor;
+            int taps = std::min<int>(BLUR_MAX_TAPS, std::ceil(radius));
+            float sigma = std::max(radius / 2, 0.5f);
+            float weights[BLUR_MAX_TAPS + 1] = {};
+            float total = 0.f;
+            for(int i = 0; i <= taps; i++){
+                weights[i] = std::exp(-i * i / (2 * sigma * sigma));
+                total += i == 0 ? weights[i] : 2 * weights[i];
+            }
+            for(int i = 0; i <= taps; i++){
+                weights[i] /= total;
+            }
+            l_blurShader->setUniformArray("weights", weights, BLUR_MAX_TAPS + 1);
+            l_blurShader->setUniform("taps", taps);
+            l_blurShader->setUniform("step", sf::Glsl::Vec2(1.f / low.x, 0.f));
+            blit(m_blurTextures[0].getTexture(), m_blurTextures[1], l_blurShader.get());
+            l_blurShader->setUniform("step", sf::Glsl::Vec2(0.f, 1.f / low.y));
+            blit(m_blurTextures[1].getTexture(), m_blurTextures[0], l_blurShader.get());
+        }
+        blit(m_blurTextures[0].getTexture(), m_renderTexture, nullptr);
+    }
+    
     void LightingArea::display(){
+        CANDLE_TRACE_ZONE("LightingArea::display");
         m_renderTexture.display();
+        if(m_blurRadius > 0.f){
+            blur();
+        }
     }
 }
@@ -0,0 +1,256 @@
+#include "Candle/OccluderGenerator.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Candle/Parallel.hpp"
+#include "Candle/Trace.hpp"
+
+namespace candle{
+    // Sides of a cell of marching squares
+    enum CellSide{ TOP, RIGHT, BOTTOM, LEFT };
+
+    // Sides joined by the outline for every case of a cell, whose bits are
+    // the solid corners: top left 8, top right 4, bottom right 2 and bottom
+    // left 1. Every pair goes from one side to the other with the solid
+    // corners at its right (y goes down), so the outlines go clockwise around
+    // the solid regions.
+    const int CELL_SEGMENTS[16][4] = {
+        { -1, -1, -1, -1 },
+        { LEFT, BOTTOM, -1, -1 },
+        { BOTTOM, RIGHT, -1, -1 },
+        { LEFT, RIGHT, -1, -1 },
+        { RIGHT, TOP, -1, -1 },
+        { RIGHT, TOP, LEFT, BOTTOM },
+        { BOTTOM, TOP, -1, -1 },
+        { LEFT, TOP, -1, -1 },
+        { TOP, LEFT, -1, -1 },
+        { TOP, BOTTOM, -1, -1 },
+        { TOP, LEFT, BOTTOM, RIGHT },
+        { TOP, RIGHT, -1, -1 },
+        { RIGHT, LEFT, -1, -1 },
+        { RIGHT, BOTTOM, -1, -1 },
+        { BOTTOM, LEFT, -1, -1 },
+        { -1, -1, -1, -1 }
+    };
+
+    // The saddles 5 and 10 with a solid center, where the outline goes
+    // around the empty corners instead of the solid ones
+    const int SADDLE_SEGMENTS[2][4] = {
+        { LEFT, TOP, RIGHT, BOTTOM },
+        { TOP, RIGHT, BOTTOM, LEFT }
+    };
+
+    // Distance from a point to a segment
+    float segmentDistance(const sf::Vector2f& p, const sf::Vector2f& a, const sf::Vector2f& b){
+        sf::Vector2f ab = b - a;
+        float len2 = ab.lengthSquared();
+        float t = len2 > 0.f ? std::clamp((p - a).dot(ab) / len2, 0.f, 1.f) : 0.f;
+        return (p - (a + t * ab)).length();
+    }
+
+    // Douglas-Peucker: marks the points of [first, last] to keep, which
+    // always include both ends
+    void simplify(const std::vector<sf::Vector2f>& points, size_t first, size_t last,
+                  float tolerance, std::vector<char>& keep){
+        keep[first] = keep[last] = 1;
+        std::vector<std::pair<size_t, size_t>> stack{ { first, last } };
+        while(!stack.empty()){
+            size_t a = stack.back().first, b = stack.back().second;
+            stack.pop_back();
+            float farthest = tolerance;
+            size_t split = a;
+            for(size_t i = a + 1; i < b; i++){
+                float d = segmentDistance(points[i], points[a], points[b]);
+                if(d > farthest){
+                    farthest = d;
+                    split = i;
+                }
+            }
+            if(split != a){
+                keep[split] = 1;
+                stack.push_back({ a, split });
+                stack.push_back({ split, b });
+            }
+        }
+    }
+
+    OccluderGenerator::OccluderGenerator()
+        : m_tolerance(1.f)
+        , m_threshold(128)
+        , m_tileSize(256)
+        , m_threads(0)
+        {}
+
+    void OccluderGenerator::setTolerance(float tolerance){
+        m_tolerance = std::max(0.f, tolerance);
+    }
+
+    float OccluderGenerator::getTolerance() const{
+        return m_tolerance;
+    }
+
+    void OccluderGenerator::setAlphaThreshold(std::uint8_t threshold){
+        m_threshold = threshold;
+    }
+
+    std::uint8_t OccluderGenerator::getAlphaThreshold() const{
+        return m_threshold;
+    }
+
+    void OccluderGenerator::setTileSize(unsigned int pixels){
+        m_tileSize = std::max(1u, pixels);
+    }
+
+    unsigned int OccluderGenerator::getTileSize() const{
+        return m_tileSize;
+    }
+
+    void OccluderGenerator::setThreadCount(unsigned int threads){
+        m_threads = threads;
+    }
+
+    unsigned int OccluderGenerator::getThreadCount() const{
+        return m_threads;
+    }
+
+    size_t OccluderGenerator::generate(const sf::Image& mask, EdgeVector& out, const sf::Transform& transform) const{
+        CANDLE_TRACE_ZONE("OccluderGenerator::generate");
+        const int width = mask.getSize().x, height = mask.getSize().y;
+        const std::uint8_t* pixels = mask.getPixelsPtr();
+        if(width == 0 || height == 0 || pixels == nullptr){
+            return 0;
+        }
+        // the samples are the centers of the pixels, with a transparent
+        // border around the image so every outline is closed; the cell
+        // (x, y) has the samples (x - 1, y - 1) to (x, y) as corners
+        auto alpha = [&] (int x, int y) -> int{
+            if(x < 0 || y < 0 || x >= width || y >= height){
+                return 0;
+            }
+            return pixels[(y * width + x) * 4 + 3];
+        };
+        const float threshold = m_threshold;
+        const unsigned int cellsX = width + 1, cellsY = height + 1;
+        const unsigned int tilesX = (cellsX + m_tileSize - 1) / m_tileSize;
+        const unsigned int tilesY = (cellsY + m_tileSize - 1) / m_tileSize;
+        std::vector<EdgeVector> tileEdges(tilesX * tilesY);
+
+        parallelFor(tileEdges.size(), m_threads, 1,
+            [&] (size_t b, size_t e, unsigned int){
+                for(size_t tile = b; tile < e; tile++){
+                    const int x0 = (tile % tilesX) * m_tileSize;
+                    const int y0 = (tile / tilesX) * m_tileSize;
+                    const int tw = std::min(m_tileSize, cellsX - x0);
+                    const int th = std::min(m_tileSize, cellsY - y0);
+                    // the crossings of the outline are identified by the
+                    // side of a cell they are in: the horizontal side from
+                    // the local sample (u, v) is 2 * (v * (tw + 1) + u), the
+                    // vertical one is the next
+                    auto sideKey = [tw] (int u, int v, int side) -> int{
+                        switch(side){
+                            case TOP: return 2 * (v * (tw + 1) + u);
+                            case RIGHT: return 2 * (v * (tw + 1) + u + 1) + 1;
+                            case BOTTOM: return 2 * ((v + 1) * (tw + 1) + u);
+                            default: return 2 * (v * (tw + 1) + u) + 1;
+                        }
+                    };
+                    auto crossing = [&] (int key) -> sf::Vector2f{
+                        int sample = key / 2;
+                        int x = x0 + sample % (tw + 1) - 1;
+                        int y = y0 + sample / (tw + 1) - 1;
+                        int nx = x + (key % 2 == 0), ny = y + (key % 2 == 1);
+                        float a = alpha(x, y), b = alpha(nx, ny);
+                        float t = std::clamp((threshold - a) / (b - a), 0.f, 1.f);
+                        return { x + 0.5f + (nx - x) * t, y + 0.5f + (ny - y) * t };
+                    };
+
+                    // segments of the outline, and the ones that start and
+                    // end at every crossing
+                    std::vector<std::pair<int, int>> segments;
+                    std::vector<int> outgoing(2 * (tw + 1) * (th + 1), -1);
+                    std::vector<char> incoming(outgoing.size(), 0);
+                    for(int v = 0; v < th; v++){
+                        for(int u = 0; u < tw; u++){
+                            int x = x0 + u - 1, y = y0 + v - 1;
+                            int a[4] = { alpha(x, y), alpha(x + 1, y), alpha(x + 1, y + 1), alpha(x, y + 1) };
+                            int index = (a[0] >= threshold) << 3 | (a[1] >= threshold) << 2
+                                      | (a[2] >= threshold) << 1 | (a[3] >= threshold);
+                            const int* sides = CELL_SEGMENTS[index];
+                            if((index == 5 || index == 10) && (a[0] + a[1] + a[2] + a[3]) / 4.f >= threshold){
+                                sides = SADDLE_SEGMENTS[index == 10];
+                            }
+                            for(int i = 0; i < 4 && sides[i] >= 0; i += 2){
+                                int k1 = sideKey(u, v, sides[i]), k2 = sideKey(u, v, sides[i + 1]);
+                                outgoing[k1] = segments.size();
+                                incoming[k2] = 1;
+                                segments.push_back({ k1, k2 });
+                            }
+                        }
+                    }
+
+                    // chain the segments, first the ones that end at the
+                    // border of the tile, then the closed outlines
+                    EdgeVector& edges = tileEdges[tile];
+                    std::vector<char> used(segments.size(), 0);
+                    std::vector<sf::Vector2f> points;
+                    std::vector<char> keep;
+                    auto chain = [&] (int segment){
+                        points.clear();
+                        points.push_back(crossing(segments[segment].first));
+                        while(segment >= 0 && !used[segment]){
+                            used[segment] = 1;
+                            int key = segments[segment].second;
+                            points.push_back(crossing(key));
+                            segment = outgoing[key];
+                        }
+                        size_t n = points.size();
+                        if(n < 2){
+                            return;
+                        }
+                        keep.assign(n, 0);
+                        if(segment >= 0){
+                            // closed: the ends are the first point and the
+                            // farthest from it
+                            size_t far = 0;
+                            for(size_t i = 1; i < n; i++){
+                                if((points[i] - points[0]).lengthSquared() > (points[far] - points[0]).lengthSquared()){
+                                    far = i;
+                                }
+                            }
+                            simplify(points, 0, far, m_tolerance, keep);
+                            simplify(points, far, n - 1, m_tolerance, keep);
+                        }else{
+                            simplify(points, 0, n - 1, m_tolerance, keep);
+                        }
+                        sf::Vector2f last = transform.transformPoint(points[0]);
+                        for(size_t i = 1; i < n; i++){
+                            if(keep[i]){
+                                sf::Vector2f p = transform.transformPoint(points[i]);
+                                edges.emplace_back(last, p);
+                                last = p;
+                            }
+                        }
+                    };
+                    for(size_t key = 0; key < outgoing.size(); key++){
+                        if(outgoing[key] >= 0 && !incoming[key]){
+                            chain(outgoing[key]);
+                        }
+                    }
+                    for(size_t s = 0; s < segments.size(); s++){
+                        if(!used[s]){
+                            chain(s);
+                        }
+                    }
+                }
+            }
+        );
+
+        size_t count = 0;
+        for(auto& edges: tileEdges){
+            out.insert(out.end(), edges.begin(), edges.end());
+            count += edges.size();
+        }
+        return count;
+    }
+}
@@ -0,0 +1,120 @@
+#include "Candle/Parallel.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+
+namespace candle{
+    class WorkerPool{
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::deque<std::function<void()>> m_tasks;
+        std::vector<std::thread> m_workers;
+        bool m_stopping;
+
+        void work(){
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while(true){
+                m_wake.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+                if(m_tasks.empty()){
+                    return;
+                }
+                std::function<void()> task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+                lock.unlock();
+                task();
+                lock.lock();
+            }
+        }
+
+    public:
+        WorkerPool()
+            : m_stopping(false)
+            {
+            unsigned int threads = std::max(resolveThreadCount(0), 2u) - 1;
+            for(unsigned int i = 0; i < threads; i++){
+                m_workers.emplace_back(&WorkerPool::work, this);
+            }
+        }
+
+        ~WorkerPool(){
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stopping = true;
+            }
+            m_wake.notify_all();
+            for(auto& w: m_workers){
+                w.join();
+            }
+        }
+
+        void push(std::function<void()> task){
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_tasks.push_back(std::move(task));
+            }
+            m_wake.notify_one();
+        }
+    };
+
+    WorkerPool& workerPool(){
+        static WorkerPool pool;
+        return pool;
+    }
+
+    void runInBackground(std::function<void()> task){
+        workerPool().push(std::move(task));
+    }
+
+    // Blocks of a call to runBlocks, shared with the workers that help,
+    // which may get to it after the call returned
+    struct BlockQueue{
+        const std::function<void(size_t)>* body;
+        size_t blocks;
+        std::atomic<size_t> next;
+        std::mutex mutex;
+        std::condition_variable finished;
+        size_t done;
+        std::exception_ptr error;
+
+        // take blocks until there are none left; the body is only touched
+        // while a block is taken, so the caller is still waiting
+        void run(){
+            for(size_t b = next++; b < blocks; b = next++){
+                std::exception_ptr e;
+                try{
+                    (*body)(b);
+                }catch(...){
+                    e = std::current_exception();
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                if(e && !error){
+                    error = e;
+                }
+                if(++done == blocks){
+                    finished.notify_all();
+                }
+            }
+        }
+    };
+
+    void runBlocks(size_t blocks, const std::function<void(size_t)>& body){
+        auto queue = std::make_shared<BlockQueue>();
+        queue->body = &body;
+        queue->blocks = blocks;
+        queue->next = 0;
+        queue->done = 0;
+        for(size_t i = 1; i < blocks; i++){
+            workerPool().push([queue] { queue->run(); });
+        }
+        queue->run();
+        std::unique_lock<std::mutex> lock(queue->mutex);
+        queue->finished.wait(lock, [&] { return queue->done == queue->blocks; });
+        if(queue->error){
+            std::rethrow_exception(queue->error);
+        }
+    }
+}
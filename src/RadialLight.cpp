@@ -2,7 +2,12 @@
 #include <iostream>
 #endif
 
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <type_traits>
 #include "Candle/RadialLight.hpp"
 
 #include "SFML/Graphics.hpp"
@@ -10,15 +15,38 @@
 #include "Candle/graphics/VertexArray.hpp"
 #include "Candle/geometry/Vector2.hpp"
 #include "Candle/geometry/Line.hpp"
+#include "Candle/Parallel.hpp"
+#include "Candle/Trace.hpp"
 
 namespace candle{
     int RadialLight::s_instanceCount = 0;
     const float BASE_RADIUS = 400.0f;
+    // Shortest edge (relative to the range) and maximum number of rays (0 for
+    // no limit) of each level of detail
+    const float DETAIL_MIN_EDGE[] = { 0.f, 1.f / 32, 1.f / 8, 0.f };
+    const size_t DETAIL_MAX_RAYS[] = { 0, 256, 64, 0 };
+    // Minimum size of the blocks of work given to each thread
+    const size_t PARALLEL_MIN_EDGES = 4096;
+    const size_t PARALLEL_MIN_RAYS = 1024;
+    // Consecutive rays closer than this angle (in radians) whose hits differ
+    // more than the step (in texture units) are the sides of a silhouette
+    const float PENUMBRA_MAX_GAP = 1e-3f;
+    const float PENUMBRA_MIN_STEP = 1.f;
+    const float PENUMBRA_MAX_ANGLE = 30.f * sfu::PI / 180.f;
+    // Degrees the cone used to cull edges is wider than the beam
+    const float SECTOR_MARGIN = 0.1f;
+    // Part of the radius the rays towards the tangent points of a circle go
+    // inside it, so they hit it
+    const float CIRCLE_TANGENT_INSET = 1e-4f;
+    // Longest run of vertices merged into one segment, which bounds the cost
+    // of checking them
+    const size_t MERGE_MAX_RUN = 64;
     bool l_texturesReady(false);
     std::unique_ptr<sf::RenderTexture> l_lightTextureFade;
     std::unique_ptr<sf::RenderTexture> l_lightTexturePlain;
 
     void initializeTextures(){
+        CANDLE_TRACE_ZONE("initializeTextures");
         #ifdef CANDLE_DEBUG
         std::cout << "RadialLight: InitializeTextures" << std::endl;
         #endif
@@ -49,6 +77,7 @@ namespace candle{
         l_lightTexturePlain->draw(lightShape);
         l_lightTexturePlain->display();
         l_lightTexturePlain->setSmooth(true);
+        l_texturesReady = true;
     }
 
     float module360(float x){
@@ -60,11 +89,6 @@ namespace candle{
     RadialLight::RadialLight()
         : LightSource()
         {
-        if(!l_texturesReady){
-            // The first time we create a RadialLight, we must create the textures
-            initializeTextures();
-            l_texturesReady = true;
-        }
         m_polygon.setPrimitiveType(sf::PrimitiveType::TriangleFan);
         m_polygon.resize(6);
         m_polygon[0].position =
@@ -82,10 +106,39 @@ namespace candle{
         Transformable::setOrigin({ BASE_RADIUS, BASE_RADIUS });
         setRange(1.0f);
         setBeamAngle(360.f);
+        setDetailLevel(FULL);
+        setDetailThresholds(128.f, 32.f, 8.f);
+        setThreadCount(1);
+        m_penumbra.setPrimitiveType(sf::PrimitiveType::Triangles);
+        setSourceRadius(0.f);
+        setMergeTolerance(0.f);
         // castLight();
         s_instanceCount++;
     }
 
+    RadialLight::RadialLight(const RadialLight& other)
+        : LightSource(other)
+        , m_beamAngle(other.m_beamAngle)
+        , m_detail(other.m_detail)
+        , m_threads(other.m_threads)
+        , m_sourceRadius(other.m_sourceRadius)
+        , m_mergeTolerance(other.m_mergeTolerance)
+        , m_penumbra(other.m_penumbra)
+    {
+        std::copy(other.m_detailThresholds, other.m_detailThresholds + 3, m_detailThresholds);
+        s_instanceCount++;
+    }
+
+    std::unique_ptr<LightSource> RadialLight::clone() const{
+        return std::make_unique<RadialLight>(*this);
+    }
+
+    sf::Transform RadialLight::getPolygonTransform() const{
+        sf::Transform trm = Transformable::getTransform();
+        trm.scale({ m_range / BASE_RADIUS, m_range / BASE_RADIUS }, { BASE_RADIUS, BASE_RADIUS });
+        return trm;
+    }
+
     RadialLight::~RadialLight(){
         s_instanceCount--;
         #ifdef RADIAL_LIGHT_FIX
@@ -104,14 +157,22 @@ namespace candle{
     }
 
     void RadialLight::draw(sf::RenderTarget& t, sf::RenderStates s) const{
-        sf::Transform trm = Transformable::getTransform();
-        trm.scale({ m_range / BASE_RADIUS, m_range / BASE_RADIUS }, { BASE_RADIUS, BASE_RADIUS });
-        s.transform *= trm;
+        if(!isVisible(t.getView(), s.transform)){
+            return;
+        }
+        if(!l_texturesReady){
+            // The first time we draw a RadialLight, we must create the textures
+            initializeTextures();
+        }
+        s.transform *= getDrawTransform();
         s.texture = m_fade ? &l_lightTextureFade->getTexture() : &l_lightTexturePlain->getTexture();
         if(s.blendMode == sf::BlendAlpha){
             s.blendMode = sf::BlendAdd;
         }
-        t.draw(m_polygon, s);
+        drawGeometry(t, s, m_polygon, m_polygonCache);
+        if(m_penumbra.getVertexCount() > 0){
+            drawGeometry(t, s, m_penumbra, m_penumbraCache);
+        }
 #ifdef CANDLE_DEBUG
         sf::RenderStates deb_s;
         deb_s.transform = s.transform;
@@ -119,7 +180,12 @@ namespace candle{
 #endif
     }
     void RadialLight::resetColor(){
-        sfu::setColor(m_polygon, m_color);
+        // the fade is in the texture, and the third vertex of every wedge,
+        // the one inside the shadow, is always transparent
+        sfu::setColor(m_polygon, sf::Color::White);
+        for(size_t i = 0; i < m_penumbra.getVertexCount(); i++){
+            m_penumbra[i].color = i % 3 == 2 ? sf::Color::Transparent : sf::Color::White;
+        }
     }
 
     void RadialLight::setBeamAngle(float r){
@@ -141,92 +207,559 @@ namespace candle{
         return trm.transformRect( getLocalBounds() );
     }
 
+    void RadialLight::swapGeometry(LightSource& other){
+        LightSource::swapGeometry(other);
+        std::swap(m_penumbra, static_cast<RadialLight&>(other).m_penumbra);
+    }
+
+    void RadialLight::setSourceRadius(float radius){
+        m_sourceRadius = radius;
+    }
+
+    float RadialLight::getSourceRadius() const{
+        return m_sourceRadius;
+    }
+
+    void RadialLight::setMergeTolerance(float tolerance){
+        m_mergeTolerance = std::max(0.f, tolerance);
+    }
+
+    float RadialLight::getMergeTolerance() const{
+        return m_mergeTolerance;
+    }
+
+    /*
+     * Circle or cone of a light, to cull the edges that can't cast shadows.
+     */
+    struct Sector{
+        sf::Vector2f center;
+        float range2;
+        bool cone;
+        bool convex;
+        sf::Vector2f dir1, dir2;
+        sf::FloatRect bounds;
+
+        Sector(const sf::Vector2f& c, float range, float beam, float bl1)
+            : center(c)
+            , range2(range * range)
+            , cone(beam < 360.f)
+            , convex(beam + 2 * SECTOR_MARGIN <= 180.f)
+        {
+            // a bit wider than the beam, like the sorting of the rays
+            float a1 = (bl1 - SECTOR_MARGIN) * sfu::PI / 180.f;
+            float a2 = (bl1 + beam + SECTOR_MARGIN) * sfu::PI / 180.f;
+            dir1 = { std::cos(a1), std::sin(a1) };
+            dir2 = { std::cos(a2), std::sin(a2) };
+            sf::Vector2f low = c, high = c;
+            auto extend = [&](const sf::Vector2f& p){
+                low = { std::min(low.x, p.x), std::min(low.y, p.y) };
+                high = { std::max(high.x, p.x), std::max(high.y, p.y) };
+            };
+            if(cone){
+                extend(c + range * dir1);
+                extend(c + range * dir2);
+            }
+            const sf::Vector2f axes[4] = { {1.f, 0.f}, {0.f, 1.f}, {-1.f, 0.f}, {0.f, -1.f} };
+            for(auto& axis: axes){
+                if(contains(axis)){
+                    extend(c + range * axis);
+                }
+            }
+            bounds = sf::FloatRect(low, high - low);
+        }
+
+        // direction relative to the center inside the angle of the cone
+        bool contains(const sf::Vector2f& d) const{
+            if(!cone){
+                return true;
+            }
+            bool in1 = dir1.cross(d) >= 0.f;
+            bool in2 = d.cross(dir2) >= 0.f;
+            return convex ? in1 && in2 : in1 || in2;
+        }
+
+        bool intersects(const sfu::Line& s) const{
+            if(!bounds.findIntersection(s.getGlobalBounds())){
+                return false;
+            }
+            sf::Vector2f o = s.m_origin - center;
+            sf::Vector2f d = s.m_direction;
+            float t0 = 0.f, t1 = 1.f;
+            if(cone && convex){
+                // clip the segment to the two half planes of the cone
+                auto clip = [&](float a, float b){
+                    // keep a + t*b >= 0
+                    if(b == 0.f){
+                        if(a < 0.f){
+                            t1 = -1.f;
+                        }
+                    }else if(b > 0.f){
+                        t0 = std::max(t0, -a / b);
+                    }else{
+                        t1 = std::min(t1, -a / b);
+                    }
+                };
+                clip(dir1.cross(o), dir1.cross(d));
+                clip(o.cross(dir2), d.cross(dir2));
+                if(t0 > t1){
+                    return false;
+                }
+            }else if(cone && !contains(o) && !contains(o + d)){
+                // the segment must cross one of the limits of the cone
+                if(!crossesLimit(o, d, dir1) && !crossesLimit(o, d, dir2)){
+                    return false;
+                }
+            }
+            // distance from the center to the (clipped) segment
+            float l2 = sfu::magnitude2(d);
+            float t = l2 > 0.f ? std::max(t0, std::min(t1, -sfu::dot(o, d) / l2)) : t0;
+            return sfu::magnitude2(o + t * d) <= range2;
+        }
+
+        // the segment o + t*d, t in [0, 1] crosses the ray from the center
+        static bool crossesLimit(const sf::Vector2f& o, const sf::Vector2f& d, const sf::Vector2f& dir){
+            float denom = d.cross(dir);
+            if(denom == 0.f){
+                return false;
+            }
+            float t = o.cross(dir) / -denom;
+            float u = o.cross(d) / -denom;
+            return t >= 0.f && t <= 1.f && u >= 0.f;
+        }
+    };
+
+    // Bring the hit of a ray closer if a circle blocks it before
+    sf::Vector2f closestHit(const std::vector<sfu::Circle>& circles, const sfu::Line& ray, const sf::Vector2f& hit){
+        // the direction is set apart, not as the difference of two far
+        // points, which would turn it enough to miss the circles it grazes
+        sfu::Line unit = ray;
+        unit.m_direction = sfu::normalize(ray.m_direction);
+        float range = sfu::magnitude(hit - ray.m_origin);
+        for(auto& c: circles){
+            float t;
+            if(c.intersection(unit, t) && t < range){
+                range = t;
+            }
+        }
+        return unit.point(range);
+    }
+
+    // Remove the points of a fan whose ray, from the center, hits the segment
+    // from the last point kept to the next one closer than the tolerance.
+    // The distance is measured along the rays, and not to the segment,
+    // because a segment almost aligned with the rays may pass close to a
+    // point and still move the polygon far away in the wedge it spans. The
+    // ends are always kept.
+    size_t mergeCollinear(std::vector<sf::Vector2f>& points, const sf::Vector2f& center, float tolerance){
+        size_t n = points.size();
+        if(tolerance <= 0.f || n < 3){
+            return 0;
+        }
+        size_t anchor = 0, kept = 1;
+        for(size_t i = 1; i + 1 < n; i++){
+            // can the points after the anchor, up to i, be dropped?
+            sf::Vector2f ca = points[anchor] - center;
+            sf::Vector2f ab = points[i + 1] - points[anchor];
+            bool merge = i - anchor < MERGE_MAX_RUN;
+            for(size_t j = anchor + 1; j <= i && merge; j++){
+                // center + t * cp = a + u * ab
+                sf::Vector2f cp = points[j] - center;
+                float den = cp.cross(ab);
+                float t = ca.cross(ab) / den;
+                float u = ca.cross(cp) / den;
+                merge = den != 0.f && t > 0.f && u >= 0.f && u <= 1.f
+                    && std::abs(t - 1.f) * sfu::magnitude(cp) <= tolerance;
+            }
+            if(!merge){
+                anchor = i;
+                points[kept++] = points[i];
+            }
+        }
+        points[kept++] = points[n - 1];
+        points.resize(kept);
+        return n - kept;
+    }
+
+    void RadialLight::castPenumbrae(const std::vector<sf::Vector2f>& points, bool closed){
+        CANDLE_TRACE_ZONE("RadialLight::castPenumbrae");
+        m_penumbra.clear();
+        if(m_sourceRadius <= 0.f || m_detail != FULL || points.size() < 2){
+            return;
+        }
+        // the polygon is in the coordinates of the texture
+        float radius = m_sourceRadius * BASE_RADIUS / m_range;
+        sf::Vector2f center(BASE_RADIUS, BASE_RADIUS);
+        size_t n = closed ? points.size() : points.size() - 1;
+        for(size_t i = 0; i < n; i++){
+            sf::Vector2f a = points[i] - center;
+            sf::Vector2f b = points[(i + 1) % points.size()] - center;
+            float da = sfu::magnitude(a);
+            float db = sfu::magnitude(b);
+            if(da <= 0.f || db <= 0.f
+                || std::abs(a.cross(b)) > da * db * PENUMBRA_MAX_GAP
+                || std::abs(da - db) < PENUMBRA_MIN_STEP){
+                continue;
+            }
+            // the wedge starts at the endpoint, goes along the side of the
+            // lit area and fades rotating towards the shadow
+            sf::Vector2f near = da < db ? a : b;
+            sf::Vector2f far = da < db ? b : a;
+            float angle = std::min(std::atan(radius / std::min(da, db)), PENUMBRA_MAX_ANGLE);
+            if(far.cross(near) < 0.f){
+                angle = -angle;
+            }
+            // rays that don't hit anything go far beyond the texture
+            sf::Vector2f side = far - near;
+            float length = sfu::magnitude(side);
+            if(length > 2 * BASE_RADIUS){
+                side *= 2 * BASE_RADIUS / length;
+                far = near + side;
+            }
+            sf::Vector2f rotated(
+                side.x * std::cos(angle) - side.y * std::sin(angle),
+                side.x * std::sin(angle) + side.y * std::cos(angle)
+            );
+            sf::Vector2f wedge[3] = { center + near, center + far, center + near + rotated };
+            for(int v = 0; v < 3; v++){
+                sf::Vertex vertex;
+                vertex.position = vertex.texCoords = wedge[v];
+                vertex.color = v == 2 ? sf::Color::Transparent : sf::Color::White;
+                m_penumbra.append(vertex);
+            }
+        }
+    }
+
+    void RadialLight::setThreadCount(unsigned int threads){
+        m_threads = threads;
+    }
+
+    unsigned int RadialLight::getThreadCount() const{
+        return m_threads;
+    }
+
+    void RadialLight::setDetailLevel(DetailLevel level){
+        m_detail = level;
+    }
+
+    RadialLight::DetailLevel RadialLight::getDetailLevel() const{
+        return m_detail;
+    }
+
+    void RadialLight::setDetailThresholds(float reduced, float minimal, float unshadowed){
+        m_detailThresholds[0] = reduced;
+        m_detailThresholds[1] = minimal;
+        m_detailThresholds[2] = unshadowed;
+    }
+
+    RadialLight::DetailLevel RadialLight::updateDetailLevel(float screenRadius){
+        if(screenRadius < m_detailThresholds[2]){
+            m_detail = UNSHADOWED;
+        }else if(screenRadius < m_detailThresholds[1]){
+            m_detail = MINIMAL;
+        }else if(screenRadius < m_detailThresholds[0]){
+            m_detail = REDUCED;
+        }else{
+            m_detail = FULL;
+        }
+        return m_detail;
+    }
+
+    RadialLight::DetailLevel RadialLight::updateDetailLevel(const sf::View& view, const sf::Vector2u& targetSize){
+        float pixelsPerUnit = targetSize.x * view.getViewport().size.x / view.getSize().x;
+        float scale = std::max(std::abs(getScale().x), std::abs(getScale().y));
+        return updateDetailLevel(m_range * scale * pixelsPerUnit);
+    }
+
+    RadialLight::DetailLevel RadialLight::updateDetailLevel(const sf::Vector2f& camera, float focalLength){
+        float distance = sfu::magnitude(getPosition() - camera);
+        if(distance <= 0.f){
+            return updateDetailLevel(std::numeric_limits<float>::infinity());
+        }
+        return updateDetailLevel(m_range * focalLength / distance);
+    }
+
+    /*
+     * Kinds of beams. The cast is specialized for each one at compile time,
+     * so the checks of the angles of the rays don't branch on the kind.
+     */
+    // Whole circle: every angle is in the beam
+    struct OmniBeam{
+        static constexpr bool OMNI = true;
+        static bool contains(float, float, float){ return true; }
+        static float sortKey(float a, float){ return a; }
+    };
+    // Cone that doesn't cross the angle 0, sorted by angle
+    struct SpotBeam{
+        static constexpr bool OMNI = false;
+        static bool contains(float a, float bl1, float bl2){ return a > bl1 && a < bl2; }
+        static float sortKey(float a, float){ return a; }
+    };
+    // Cone that crosses the angle 0. It is sorted by the angle from its first
+    // limit (with some margin), which is in [0, 360) like any angle, so the
+    // keys are compared as plain numbers and the beam is one range of them.
+    struct WrappedSpotBeam{
+        static constexpr bool OMNI = false;
+        static bool contains(float a, float bl1, float bl2){ return a > bl1 || a < bl2; }
+        static float sortKey(float a, float bl1){ return module360(a - (bl1 - 0.1f)); }
+    };
+
     void RadialLight::castLight(const EdgeVector::iterator& begin, const EdgeVector::iterator& end){
-        float scaledRange = m_range / BASE_RADIUS;
-        sf::Transform trm = Transformable::getTransform();
-        trm.scale({ scaledRange, scaledRange }, { BASE_RADIUS, BASE_RADIUS });
-        std::vector<sfu::Line> rays;
+        CircleVector circles;
+        castBeam(begin, end, circles.cbegin(), circles.cend());
+    }
 
-        rays.reserve(2 + std::distance(begin, end) * 2 * 3); // 2: beam angle, 4: corners, 2: pnts/sgmnt, 3 rays/pnt
+    void RadialLight::castLight(const EdgeVector::iterator& begin, const EdgeVector::iterator& end,
+                                const CircleVector::const_iterator& circlesBegin,
+                                const CircleVector::const_iterator& circlesEnd){
+        castBeam(begin, end, circlesBegin, circlesEnd);
+    }
 
-        // Start casting
+    void RadialLight::castLight(const CompactEdgeVector::const_iterator& begin,
+                                const CompactEdgeVector::const_iterator& end){
+        CircleVector circles;
+        castBeam(begin, end, circles.cbegin(), circles.cend());
+    }
+
+    template <typename Iterator>
+    void RadialLight::castBeam(const Iterator& begin, const Iterator& end,
+                               const CircleVector::const_iterator& circlesBegin,
+                               const CircleVector::const_iterator& circlesEnd){
+        CANDLE_TRACE_ZONE("RadialLight::castLight");
         float bl1 = module360(getRotation().asDegrees() - m_beamAngle / 2);
         float bl2 = module360(getRotation().asDegrees() + m_beamAngle / 2);
-        bool beamAngleBigEnough = m_beamAngle < 0.1f;
+        if(m_beamAngle < 0.1f){
+            cast<OmniBeam>(begin, end, circlesBegin, circlesEnd);
+        }else if(bl1 < bl2){
+            cast<SpotBeam>(begin, end, circlesBegin, circlesEnd);
+        }else{
+            cast<WrappedSpotBeam>(begin, end, circlesBegin, circlesEnd);
+        }
+    }
+
+    template <typename Beam, typename Iterator>
+    void RadialLight::cast(const Iterator& begin, const Iterator& end,
+                           const CircleVector::const_iterator& circlesBegin,
+                           const CircleVector::const_iterator& circlesEnd){
+#ifdef CANDLE_STATISTICS
+        sf::Clock clock;
+        CastStatistics stats;
+        stats.casts = 1;
+        stats.edgesConsidered = std::distance(begin, end) + std::distance(circlesBegin, circlesEnd);
+#endif
+        m_castTransform.reset();
+        sf::Transform trm = getPolygonTransform();
+
+        unsigned int threads = resolveThreadCount(m_threads);
+
+        float bl1 = module360(getRotation().asDegrees() - m_beamAngle / 2);
+        float bl2 = module360(getRotation().asDegrees() + m_beamAngle / 2);
+        constexpr bool beamAngleBigEnough = Beam::OMNI;
         auto castPoint = Transformable::getPosition();
+
+        // Only the edges that touch the circle of the range (or the cone of
+        // the beam) and, in coarse levels of detail, are long enough can cast
+        // shadows
+        std::vector<sfu::Line> edges;
+        std::vector<sfu::Circle> circles;
+        if(m_detail != UNSHADOWED){
+            Sector sector(castPoint, m_range, beamAngleBigEnough ? 360.f : m_beamAngle, bl1);
+            float minLength = m_range * DETAIL_MIN_EDGE[m_detail];
+            auto visible = [&] (const sfu::Line& edge){
+                return sfu::magnitude2(edge.m_direction) >= minLength * minLength
+                    && sector.intersects(edge);
+            };
+            if constexpr(std::is_base_of_v<std::random_access_iterator_tag,
+                         typename std::iterator_traits<Iterator>::iterator_category>){
+                // every block keeps its edges in order, so the result doesn't
+                // depend on the number of threads
+                std::vector<std::vector<sfu::Line>> blockEdges(threads);
+                parallelFor(std::distance(begin, end), threads, PARALLEL_MIN_EDGES,
+                    [&] (size_t b, size_t e, unsigned int block){
+                        for(auto it = begin + b; it != begin + e; it++){
+                            if(visible(*it)){
+                                blockEdges[block].push_back(*it);
+                            }
+                        }
+                    }
+                );
+                for(auto& be: blockEdges){
+                    edges.insert(edges.end(), be.begin(), be.end());
+                }
+            }else{
+                // edges decoded on the fly are only copied if they are kept
+                for(auto it = begin; it != end; it++){
+                    sfu::Line edge = *it;
+                    if(visible(edge)){
+                        edges.push_back(edge);
+                    }
+                }
+            }
+            for(auto it = circlesBegin; it != circlesEnd; it++){
+                if( 2 * it->m_radius >= minLength
+                    && !it->contains(castPoint)
+                    && sfu::magnitude(it->m_center - castPoint) <= m_range + it->m_radius
+                    && sector.bounds.findIntersection(it->getGlobalBounds()) ){
+                    circles.push_back(*it);
+                }
+            }
+        }
+#ifdef CANDLE_STATISTICS
+        stats.edgesCulled = stats.edgesConsidered - edges.size() - circles.size();
+#endif
+
+        bool subRays = m_detail == FULL;
+        std::vector<sfu::Line> rays;
+        rays.reserve(6 + (edges.size() + circles.size()) * 2 * (subRays ? 3 : 1)); // 2: beam angle, 4: corners, 2: pnts/sgmnt, 3 rays/pnt
+
+        // Start casting
         float off = .001f;
 
-        auto angleInBeam = [&](float a)-> bool {
-            return beamAngleBigEnough
-                   ||(bl1 < bl2 && a > bl1 && a < bl2)
-                   ||(bl1 > bl2 && (a > bl1 || a < bl2));
+        auto angleInBeam = [bl1, bl2](float a)-> bool {
+            return Beam::contains(a, bl1, bl2);
         };
 
-        for(float a = 45.f; a < 360.f; a += 90.f){
-            if(beamAngleBigEnough || angleInBeam(a)){
+        // rays along the arc, so the fan covers the whole sector even if
+        // there are no edges
+        if constexpr(beamAngleBigEnough){
+            for(float a = 45.f; a < 360.f; a += 90.f){
                 rays.emplace_back(castPoint, a);
             }
+        }else{
+            int arcRays = m_beamAngle / 90.f;
+            for(int i = 1; i <= arcRays; i++){
+                rays.emplace_back(castPoint, module360(bl1 + m_beamAngle * i / (arcRays + 1)));
+            }
         }
 
-        sf::FloatRect lightBounds = getGlobalBounds();
-        for(auto it = begin; it != end; it++){
-            auto& s = *it;
-
-            //Only cast a ray if the line is in range
-            if( lightBounds.findIntersection( s.getGlobalBounds() ) ){
-                sfu::Line r1(castPoint, s.m_origin);
-                sfu::Line r2(castPoint, s.point(1.f));
-                float a1 = sfu::angle(r1.m_direction);
-                float a2 = sfu::angle(r2.m_direction);
-                if(angleInBeam(a1)){
-                    rays.push_back(r1);
-                    rays.emplace_back(castPoint, a1 - off);
-                    rays.emplace_back(castPoint, a1 + off);
-                }
-                if(angleInBeam(a2)){
-                    rays.push_back(r2);
-                    rays.emplace_back(castPoint, a2 - off);
-                    rays.emplace_back(castPoint, a2 + off);
+        std::vector<std::vector<sfu::Line>> blockRays(threads);
+        parallelFor(edges.size(), threads, PARALLEL_MIN_EDGES,
+            [&] (size_t b, size_t e, unsigned int block){
+                auto& br = block == 0 ? rays : blockRays[block];
+                for(size_t i = b; i < e; i++){
+                    auto& s = edges[i];
+                    sfu::Line r1(castPoint, s.m_origin);
+                    sfu::Line r2(castPoint, s.point(1.f));
+                    float a1 = sfu::angle(r1.m_direction);
+                    float a2 = sfu::angle(r2.m_direction);
+                    // each ray is checked on its own, so endpoints on the limits
+                    // of the beam still get the ray that goes inside
+                    if(angleInBeam(a1)){
+                        br.push_back(r1);
+                    }
+                    if(angleInBeam(a2)){
+                        br.push_back(r2);
+                    }
+                    if(!subRays){
+                        continue;
+                    }
+                    if(angleInBeam(a1 - off)){
+                        br.emplace_back(castPoint, a1 - off);
+                    }
+                    if(angleInBeam(a1 + off)){
+                        br.emplace_back(castPoint, a1 + off);
+                    }
+                    if(angleInBeam(a2 - off)){
+                        br.emplace_back(castPoint, a2 - off);
+                    }
+                    if(angleInBeam(a2 + off)){
+                        br.emplace_back(castPoint, a2 + off);
+                    }
                 }
             }
+        );
+        for(auto& br: blockRays){
+            rays.insert(rays.end(), br.begin(), br.end());
+        }
+        // the rays towards the tangent points of the circles hit them, the
+        // ones just past them go by
+        for(auto& c: circles){
+            sf::Vector2f t1, t2;
+            c.tangents(castPoint, t1, t2);
+            sfu::Line r1(castPoint, t1 + (c.m_center - t1) * CIRCLE_TANGENT_INSET);
+            sfu::Line r2(castPoint, t2 + (c.m_center - t2) * CIRCLE_TANGENT_INSET);
+            if(angleInBeam(sfu::angle(r1.m_direction))){
+                rays.push_back(r1);
+            }
+            if(angleInBeam(sfu::angle(r2.m_direction))){
+                rays.push_back(r2);
+            }
+            float a1 = sfu::angle(t1 - castPoint);
+            float a2 = sfu::angle(t2 - castPoint);
+            if(subRays && angleInBeam(a1 - off)){
+                rays.emplace_back(castPoint, a1 - off);
+            }
+            if(subRays && angleInBeam(a2 + off)){
+                rays.emplace_back(castPoint, a2 + off);
+            }
         }
 
-        if(bl1 > bl2){
-            std::sort(
-                rays.begin(),
-                rays.end(),
-                [bl1, bl2] (sfu::Line& r1, sfu::Line& r2){
-                    float _bl1 = bl1-0.1;
-                    float _bl2 = bl2+0.1;
-                    float a1 = sfu::angle(r1.m_direction);
-                    float a2 = sfu::angle(r2.m_direction);
-                    return (a1 >= _bl1 && a2 <= _bl2) || (a1 < a2 && (_bl1 <= a1 || a2 <= _bl2));
+        {
+            CANDLE_TRACE_ZONE("RadialLight::sortRays");
+            // Sort by the key of the angle in the beam. Ties are broken by
+            // position, a total order that gives the same result with any
+            // number of threads.
+            std::vector<std::pair<float, unsigned int>> keys(rays.size());
+            for(unsigned int i = 0; i < rays.size(); i++){
+                keys[i] = { Beam::sortKey(sfu::angle(rays[i].m_direction), bl1), i };
+            }
+            parallelSort(keys.begin(), keys.end(), threads, PARALLEL_MIN_RAYS,
+                [] (const std::pair<float, unsigned int>& k1, const std::pair<float, unsigned int>& k2){
+                    return k1 < k2;
                 }
             );
-        }else{
-            std::sort(
-                rays.begin(),
-                rays.end(),
-                [bl1] (sfu::Line& r1, sfu::Line& r2){
-                    return
-                        sfu::angle(r1.m_direction) < sfu::angle(r2.m_direction);
+            std::vector<sfu::Line> sorted;
+            sorted.reserve(rays.capacity());
+            for(auto& k: keys){
+                sorted.push_back(rays[k.second]);
+            }
+            rays.swap(sorted);
+        }
+        size_t maxRays = DETAIL_MAX_RAYS[m_detail];
+        if(maxRays > 0 && rays.size() > maxRays){
+            // keep one ray per sector of the beam, so the whole beam is still
+            // covered
+            float beam = beamAngleBigEnough ? 360.f : m_beamAngle;
+            size_t kept = 0;
+            long lastSector = -1;
+            for(auto& r: rays){
+                long sector = module360(sfu::angle(r.m_direction) - bl1) / beam * maxRays;
+                if(sector != lastSector){
+                    rays[kept++] = r;
+                    lastSector = sector;
                 }
-            );
+            }
+            rays.erase(rays.begin() + kept, rays.end());
         }
-        if(!beamAngleBigEnough){
+        if constexpr(!beamAngleBigEnough){
             rays.emplace(rays.begin(), castPoint, bl1);
             rays.emplace_back(castPoint, bl2);
         }
 
         sf::Transform tr_i = trm.getInverse();
         // keep only the ones within the area
-        std::vector<sf::Vector2f> points;
-        points.reserve(rays.size());
-        for (auto& r: rays){
-            points.push_back(tr_i.transformPoint(castRay(begin, end,    r, m_range*m_range)));
+        std::vector<sf::Vector2f> points(rays.size());
+        {
+            CANDLE_TRACE_ZONE("RadialLight::castRays");
+            // every thread casts a contiguous block of rays
+            size_t minRays = std::max<size_t>(PARALLEL_MIN_RAYS / 64, PARALLEL_MIN_RAYS * 64 / (edges.size() + circles.size() + 1));
+            parallelFor(rays.size(), threads, minRays,
+                [&] (size_t b, size_t e, unsigned int){
+                    for(size_t i = b; i < e; i++){
+                        sf::Vector2f hit = castRay(edges.begin(), edges.end(), rays[i], m_range*m_range);
+                        if(!circles.empty()){
+                            hit = closestHit(circles, rays[i], hit);
+                        }
+                        points[i] = tr_i.transformPoint(hit);
+                    }
+                }
+            );
         }
+        // the penumbrae need every silhouette, so they go before merging
+        castPenumbrae(points, beamAngleBigEnough);
+        [[maybe_unused]] size_t merged = mergeCollinear(points, tr_i.transformPoint(castPoint),
+                                                        m_mergeTolerance * BASE_RADIUS / m_range);
         m_polygon.resize(points.size() + 1 + beamAngleBigEnough); // + center and last
-        m_polygon[0].color = m_color;
+        m_polygon[0].color = sf::Color::White;
         m_polygon[0].position = m_polygon[0].texCoords = tr_i.transformPoint(castPoint);
 #ifdef CANDLE_DEBUG
         float bl1rad = bl1 * sfu::PI/180.f;
@@ -245,7 +778,7 @@ namespace candle{
             sf::Vector2f p = points[i];
             m_polygon[i+1].position = p;
             m_polygon[i+1].texCoords = p;
-            m_polygon[i+1].color = m_color;
+            m_polygon[i+1].color = sf::Color::White;
 #ifdef CANDLE_DEBUG
             m_debug[i*2].position = m_polygon[0].position;
             m_debug[i*2+1].position = p;
@@ -255,6 +788,16 @@ namespace candle{
         if(beamAngleBigEnough){
             m_polygon[points.size()+1] = m_polygon[1];
         }
+        m_geometryVersion++;
+#ifdef CANDLE_STATISTICS
+        stats.raysGenerated = rays.size();
+        stats.verticesMerged = merged;
+        stats.intersectionTests = rays.size() * (edges.size() + circles.size());
+        stats.polygonVertices = m_polygon.getVertexCount() + m_penumbra.getVertexCount();
+        stats.castTime = clock.getElapsedTime();
+        m_stats += stats;
+        addFrameStatistics(stats);
+#endif
     }
 
 }
@@ -0,0 +1,39 @@
+#include "Candle/Statistics.hpp"
+
+#include <mutex>
+
+namespace candle{
+    CastStatistics& CastStatistics::operator+=(const CastStatistics& o){
+        casts += o.casts;
+        edgesConsidered += o.edgesConsidered;
+        edgesCulled += o.edgesCulled;
+        raysGenerated += o.raysGenerated;
+        intersectionTests += o.intersectionTests;
+        polygonVertices += o.polygonVertices;
+        verticesMerged += o.verticesMerged;
+        castTime += o.castTime;
+        return *this;
+    }
+
+    void CastStatistics::reset(){
+        *this = CastStatistics();
+    }
+
+    std::mutex l_frameMutex;
+    CastStatistics l_frameStatistics;
+
+    CastStatistics getFrameStatistics(){
+        std::lock_guard<std::mutex> lock(l_frameMutex);
+        return l_frameStatistics;
+    }
+
+    void resetFrameStatistics(){
+        std::lock_guard<std::mutex> lock(l_frameMutex);
+        l_frameStatistics.reset();
+    }
+
+    void addFrameStatistics(const CastStatistics& stats){
+        std::lock_guard<std::mutex> lock(l_frameMutex);
+        l_frameStatistics += stats;
+    }
+}
@@ -0,0 +1,92 @@
+#include "Candle/TeamVisibility.hpp"
+
+#include <algorithm>
+
+#include "Candle/Trace.hpp"
+
+namespace candle{
+    TeamVisibility::TeamVisibility(const sf::FloatRect& area, float cellSize, unsigned int teams)
+        : m_visible(teams, BitGrid(area, cellSize))
+        , m_previous(teams, BitGrid(area, cellSize))
+        , m_threads(0)
+        {}
+
+    unsigned int TeamVisibility::getTeamCount() const{
+        return m_visible.size();
+    }
+
+    void TeamVisibility::addUnit(unsigned int team, const LightSource* unit){
+        for(auto& u: m_units){
+            if(u.light == unit){
+                return;
+            }
+        }
+        m_units.push_back({ team, unit });
+    }
+
+    void TeamVisibility::removeUnit(const LightSource* unit){
+        m_units.erase(
+            std::remove_if(
+                m_units.begin(),
+                m_units.end(),
+                [unit] (const Unit& u){ return u.light == unit; }
+            ),
+            m_units.end()
+        );
+    }
+
+    void TeamVisibility::clearUnits(){
+        m_units.clear();
+    }
+
+    size_t TeamVisibility::getUnitCount() const{
+        return m_units.size();
+    }
+
+    void TeamVisibility::setThreadCount(unsigned int threads){
+        m_threads = threads;
+    }
+
+    unsigned int TeamVisibility::getThreadCount() const{
+        return m_threads;
+    }
+
+    void TeamVisibility::update(){
+        CANDLE_TRACE_ZONE("TeamVisibility::update");
+        std::swap(m_visible, m_previous);
+        if(m_visible.empty()){
+            return;
+        }
+        for(auto& grid: m_visible){
+            grid.clear();
+        }
+        // every unit lights the grid of its team, all in one pass
+        std::vector<const LightSource*> lights;
+        std::vector<BitGrid*> grids;
+        for(auto& u: m_units){
+            if(u.team < m_visible.size()){
+                lights.push_back(u.light);
+                grids.push_back(&m_visible[u.team]);
+            }
+        }
+        BitGrid::fillLights(lights, grids, m_threads);
+    }
+
+    bool TeamVisibility::isVisible(unsigned int team, int x, int y) const{
+        return m_visible[team].get(x, y);
+    }
+
+    bool TeamVisibility::isVisible(unsigned int team, const sf::Vector2f& point) const{
+        return m_visible[team].contains(point);
+    }
+
+    void TeamVisibility::getNewlyRevealed(unsigned int team, std::vector<sf::Vector2u>& out) const{
+        BitGrid revealed = m_visible[team];
+        revealed.subtract(m_previous[team]);
+        revealed.getCells(out);
+    }
+
+    const BitGrid& TeamVisibility::getGrid(unsigned int team) const{
+        return m_visible[team];
+    }
+}
@@ -0,0 +1,202 @@
+#include "Candle/Trace.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace candle{
+    struct TraceEvent{
+        const char* name;
+        std::int64_t start; // ns since the start of the recording
+        std::int64_t duration;
+    };
+
+    /*
+     * Single producer (the owner thread), single consumer (the thread that
+     * flushes) ring buffer. The producer only writes `head` and the consumer
+     * only writes `tail`, so neither of them has to wait for the other.
+     */
+    struct TraceBuffer{
+        std::vector<TraceEvent> events;
+        std::atomic<std::uint64_t> head;
+        std::atomic<std::uint64_t> tail;
+        std::atomic<std::uint64_t> dropped;
+        int thread;
+        TraceBuffer(std::size_t capacity, int t)
+            : events(capacity)
+            , head(0)
+            , tail(0)
+            , dropped(0)
+            , thread(t) {}
+        void push(const TraceEvent& e){
+            std::uint64_t h = head.load(std::memory_order_relaxed);
+            if(h - tail.load(std::memory_order_acquire) >= events.size()){
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            events[h % events.size()] = e;
+            head.store(h + 1, std::memory_order_release);
+        }
+    };
+
+    typedef std::chrono::steady_clock TraceClock;
+
+    std::atomic<bool> l_tracing(false);
+    std::atomic<std::size_t> l_traceCapacity(1 << 16);
+    // Start of the recording, in ns of the clock. It is atomic because the
+    // zones that are open while a new recording starts still read it
+    std::atomic<std::int64_t> l_traceEpoch(0);
+    // Only locked to register new threads and to flush
+    std::mutex l_traceMutex;
+    std::vector<std::shared_ptr<TraceBuffer>> l_traceBuffers;
+    // Buffers of the threads that have exited, ready for the next ones
+    std::vector<std::shared_ptr<TraceBuffer>> l_traceFreeBuffers;
+    std::ofstream l_traceFile;
+    bool l_traceFirstEvent;
+
+    std::int64_t traceClock(){
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            TraceClock::now().time_since_epoch()).count();
+    }
+
+    std::int64_t traceNow(){
+        return traceClock() - l_traceEpoch.load(std::memory_order_relaxed);
+    }
+
+    void writeTraceEvents(TraceBuffer& buffer);
+
+    /*
+     * Owns the buffer of a thread while it runs. When the thread exits, the
+     * pending events are written and the buffer, with its tid, goes to the
+     * free list, so short lived threads don't leave a buffer each behind.
+     */
+    struct TraceBufferHolder{
+        std::shared_ptr<TraceBuffer> buffer;
+        ~TraceBufferHolder(){
+            if(!buffer){
+                return;
+            }
+            std::lock_guard<std::mutex> lock(l_traceMutex);
+            if(l_traceFile.is_open()){
+                writeTraceEvents(*buffer);
+            }else{
+                buffer->tail.store(buffer->head.load());
+            }
+            l_traceFreeBuffers.push_back(std::move(buffer));
+        }
+    };
+
+    TraceBuffer& threadTraceBuffer(){
+        thread_local TraceBufferHolder holder;
+        std::shared_ptr<TraceBuffer>& buffer = holder.buffer;
+        if(!buffer){
+            std::lock_guard<std::mutex> lock(l_traceMutex);
+            if(!l_traceFreeBuffers.empty()){
+                buffer = std::move(l_traceFreeBuffers.back());
+                l_traceFreeBuffers.pop_back();
+                return *buffer;
+            }
+            buffer = std::make_shared<TraceBuffer>(
+                l_traceCapacity.load(), (int)l_traceBuffers.size() + 1);
+            l_traceBuffers.push_back(buffer);
+            if(l_traceFile.is_open()){
+                l_traceFile << (l_traceFirstEvent ? "\n" : ",\n")
+                    << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+                    << buffer->thread << ",\"args\":{\"name\":\"Thread "
+                    << buffer->thread << "\"}}";
+                l_traceFirstEvent = false;
+            }
+        }
+        return *buffer;
+    }
+
+    void writeTraceEvents(TraceBuffer& buffer){
+        std::uint64_t t = buffer.tail.load(std::memory_order_relaxed);
+        std::uint64_t h = buffer.head.load(std::memory_order_acquire);
+        for(; t < h; t++){
+            const TraceEvent& e = buffer.events[t % buffer.events.size()];
+            l_traceFile << (l_traceFirstEvent ? "\n" : ",\n")
+                << "{\"name\":\"" << e.name
+                << "\",\"cat\":\"candle\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer.thread
+                << ",\"ts\":" << e.start / 1000.0
+                << ",\"dur\":" << e.duration / 1000.0 << "}";
+            l_traceFirstEvent = false;
+        }
+        buffer.tail.store(h, std::memory_order_release);
+    }
+
+    bool startTrace(const std::string& path, std::size_t eventsPerThread){
+        std::lock_guard<std::mutex> lock(l_traceMutex);
+        if(l_tracing.load()){
+            return false;
+        }
+        l_traceFile.open(path);
+        if(!l_traceFile){
+            return false;
+        }
+        l_traceFile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        l_traceFirstEvent = true;
+        l_traceCapacity = eventsPerThread > 0 ? eventsPerThread : 1;
+        for(auto& buffer: l_traceBuffers){
+            // forget what was recorded in previous sessions
+            buffer->tail.store(buffer->head.load());
+            buffer->dropped.store(0);
+            l_traceFile << (l_traceFirstEvent ? "\n" : ",\n")
+                << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+                << buffer->thread << ",\"args\":{\"name\":\"Thread "
+                << buffer->thread << "\"}}";
+            l_traceFirstEvent = false;
+        }
+        // released with the flag, so the zones that see it see the epoch
+        l_traceEpoch.store(traceClock(), std::memory_order_relaxed);
+        l_tracing.store(true, std::memory_order_release);
+        return true;
+    }
+
+    void flushTrace(){
+        std::lock_guard<std::mutex> lock(l_traceMutex);
+        if(l_traceFile.is_open()){
+            for(auto& buffer: l_traceBuffers){
+                writeTraceEvents(*buffer);
+            }
+            l_traceFile.flush();
+        }
+    }
+
+    std::uint64_t stopTrace(){
+        l_tracing.store(false);
+        std::lock_guard<std::mutex> lock(l_traceMutex);
+        std::uint64_t dropped = 0;
+        if(l_traceFile.is_open()){
+            for(auto& buffer: l_traceBuffers){
+                writeTraceEvents(*buffer);
+                dropped += buffer->dropped.exchange(0);
+            }
+            l_traceFile << "\n]}\n";
+            l_traceFile.close();
+        }
+        return dropped;
+    }
+
+    bool isTracing(){
+        return l_tracing.load(std::memory_order_relaxed);
+    }
+
+    TraceZone::TraceZone(const char* name)
+        : m_name(name)
+        , m_start(-1)
+        {
+        if(l_tracing.load(std::memory_order_acquire)){
+            m_start = traceNow();
+        }
+    }
+
+    TraceZone::~TraceZone(){
+        if(m_start >= 0 && l_tracing.load(std::memory_order_acquire)){
+            threadTraceBuffer().push({m_name, m_start, traceNow() - m_start});
+        }
+    }
+}